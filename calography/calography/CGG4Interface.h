@@ -9,16 +9,23 @@
 
 // ---- includes -----
 #include <vector>
-#include <stack>
 #include <string>
+#include <memory>
+#include <unordered_map>
 
 #include "CaloGraphy.h"
+#include "policy.h"
+#include "builder.h"
+#include "trace.h"
+#include "stats.h"
+#include "trigger.h"
 
 #include "G4Types.hh"
 #include "G4String.hh"
 
 // forward declare Geant4 classes
 class G4Step;
+class G4VProcess;
 
 namespace cg {
 
@@ -29,6 +36,55 @@ namespace cg {
 * Simulations involving optical physics processes may violate this assumption
 * since tracks are suspended when enough optical photons are generated.
 * This class can be called from a user derived G4SteppingAction.
+*
+* By default the event graphs are kept in memory until the end of the run
+* and written by write_collection().  In streaming mode (set_streaming())
+* each graph is written to the output file by end_event() and released,
+* so memory holds one event per thread.  Worker threads encode their graph
+* and only lock the shared output file to append the finished record;
+* write_collection() then just finalizes the file.  Streaming mode needs
+* start_run() (from BeginOfRunAction) to name the file and end_event()
+* (from EndOfEventAction).
+*
+* In multi-threaded applications merge() publishes the graphs of a worker
+* to a shared event_list without taking a lock; the master reads them
+* from there.
+*
+* The recording policy (policy()) decides which steps and secondaries are
+* recorded; by default every step is.  Energy of steps and tracks which
+* are not recorded is added to the nearest recorded track node.
+*
+* With set_trajectories() each particle is recorded as a trajectory node
+* holding its step points; a new node is only started for recorded
+* secondaries, which hang from a process node at the step producing them.
+*
+* With set_pooled() the nodes of each event are allocated from a per-event
+* arena.  In streaming mode the arena is reset after the graph is written;
+* otherwise the graphs (and their memory) are released once
+* write_collection() has written them.  In multi-threaded applications
+* merge() hands the arenas of a worker to the shared event_list together
+* with its graphs, so they outlive the worker's object.
+*
+* With set_indexed() each event graph is indexed as it is built (see
+* node::build_index()), so find() and find_track() on the root take
+* constant time.
+*
+* The graph is built by a graph_builder from a step_record filled from
+* each G4Step.  With set_trace() the step records are also written to a
+* step trace (see trace.h), which can be replayed without Geant4 (see
+* tools/cgreplay.cc).  Use one trace file per thread.
+*
+* With set_stats() each thread collects statistics (see stats.h) of the
+* steps, events, merges and writes without taking a lock; merge() adds
+* them to the run statistics, which write_collection() writes as JSON
+* next to the output file (base name, run number and ".stats.json").
+*
+* With a prescale or triggers (see trigger.h and selector()) only the
+* selected graphs are kept and written: a graph is built for every N-th
+* event of each thread only, and is kept if a trigger fires on it in
+* end_event(), which is then required in all modes.  Every event keeps a
+* summary (summaries()); write_collection() writes the summaries of the
+* run next to the output file (base name, run number and ".summary.txt").
 */
 class CGG4Interface {
 public:
@@ -36,19 +92,42 @@ public:
   /**
   * @brief constructor
   */
-  CGG4Interface() { }
+  CGG4Interface()
+    :uncounted_(false)
+    ,selected_(true)
+    ,open_(false)
+    ,events_(0U)
+    ,streaming_(false)
+    ,pooled_(false)
+    ,format_(textFormat)
+    ,compression_(noCompression)
+  { }
 
   /**
   * @brief construct with a name
   * @param[in] name base name to write out data
   */
   CGG4Interface(G4String & name)
-    :base_name_(name)
+    :uncounted_(false)
+    ,selected_(true)
+    ,open_(false)
+    ,events_(0U)
+    ,streaming_(false)
+    ,pooled_(false)
+    ,format_(textFormat)
+    ,compression_(noCompression)
+    ,base_name_(name)
   { }
 
 
   // --- run level actions ---
 
+  /**
+  * @brief start a new run
+  * @param[in] run_number the run number to append to base_name for the output file name.
+  */
+  virtual void start_run(unsigned run_number);
+
   /**
   * @brief write out run
   * @param[in] run_number the run number to append to base_name for the output file name.
@@ -77,6 +156,11 @@ public:
   * @brief start a new event
   */
   virtual void start_event();
+
+  /**
+  * @brief end an event (writes and releases the graph in streaming mode)
+  */
+  virtual void end_event();
  
 
   // --- getters ---
@@ -85,6 +169,46 @@ public:
   */
   virtual const G4String & get_base_name() const { return base_name_; }
 
+  /**
+  * @brief check if graphs are streamed to the output file at the end of each event
+  */
+  virtual bool streaming() const { return streaming_; }
+
+  /**
+  * @brief check if event graphs are allocated from per-event arenas
+  */
+  virtual bool pooled() const { return pooled_; }
+
+  /**
+  * @brief check if particles are recorded as trajectories
+  */
+  virtual bool trajectories() const { return builder_.trajectories(); }
+
+  /**
+  * @brief check if event graphs are indexed as they are built
+  */
+  virtual bool indexed() const { return builder_.indexed(); }
+
+  /**
+  * @brief get the output file format
+  */
+  virtual io_format format() const { return format_; }
+
+  /**
+  * @brief get the compression of the events (binary format)
+  */
+  virtual compression compression_mode() const { return compression_; }
+
+  /**
+  * @brief get the coding of positions and momenta (binary format)
+  */
+  virtual const bin::vector_coding & coding() const { return coding_; }
+
+  /**
+  * @brief get the recording policy (may be modified before the run)
+  */
+  virtual recording_policy & policy() { return builder_.policy(); }
+
   /**
   * @brief get the number of events/graphs
   */
@@ -92,6 +216,8 @@ public:
 
   /**
   * @brief get the node_collection of showers/events
+  * @details On the master thread of a multi-threaded application this is
+  * a copy of the graphs merged so far.
   */
   virtual node_collection & collection();
   
@@ -109,22 +235,181 @@ public:
   */
   virtual void set_base_name(const G4String &name ) { base_name_ = name; }
 
+  /**
+  * @brief write each graph at the end of its event instead of the end of the run
+  */
+  virtual void set_streaming(bool stream) { streaming_ = stream; }
+
+  /**
+  * @brief allocate event graphs from per-event arenas
+  */
+  virtual void set_pooled(bool pool) { pooled_ = pool; }
+
+  /**
+  * @brief record particles as trajectories (step points in one node)
+  */
+  virtual void set_trajectories(bool trj) { builder_.set_trajectories(trj); }
+
+  /**
+  * @brief index event graphs as they are built
+  */
+  virtual void set_indexed(bool idx) { builder_.set_indexed(idx); }
+
+  /**
+  * @brief set the output file format
+  */
+  virtual void set_format(io_format fmt) { format_ = fmt; }
+
+  /**
+  * @brief set the compression of the events (binary format)
+  */
+  virtual void set_compression(compression comp) { compression_ = comp; }
+
+  /**
+  * @brief set the coding of positions and momenta (binary format)
+  */
+  virtual void set_coding(const bin::vector_coding & coding) { coding_ = coding; }
+
+  /**
+  * @brief set the recording policy
+  */
+  virtual void set_policy(const recording_policy & pol) { builder_.set_policy(pol); }
+
+  /**
+  * @brief record the steps to a step trace (an empty name closes the trace)
+  * @return false if the file can not be opened
+  */
+  virtual bool set_trace(const std::string & name);
+
+  /**
+  * @brief check if the steps are recorded to a step trace
+  */
+  virtual bool tracing() const { return trace_.is_open(); }
+
+  /**
+  * @brief collect statistics of graph building and writing
+  */
+  virtual void set_stats(bool st);
+
+  /**
+  * @brief get the statistics of this thread (NULL if not collected)
+  */
+  virtual const build_stats * stats() const { return stats_.get(); }
+
+  /**
+  * @brief get the event selection (prescale and triggers)
+  */
+  virtual event_selector & selector() { return selector_; }
+
+  /**
+  * @brief build the graphs of every n-th event only
+  */
+  virtual void set_prescale(unsigned n) { selector_.set_prescale(n); }
+
+  /**
+  * @brief add a trigger, graphs are kept if any trigger fires
+  * @return false if there are too many triggers
+  */
+  virtual bool add_trigger(const std::string & name, const event_trigger & trig) {
+    return selector_.add_trigger(name,trig);
+  }
+
+  /**
+  * @brief get the summaries of the events of this thread (with a prescale
+  * or triggers)
+  */
+  virtual const std::vector<event_summary> & summaries() const { return summaries_; }
+
+  /**
+  * @brief write the statistics of the run (merged threads and this one)
+  * as JSON and start new statistics
+  * @return false if the file can not be opened
+  */
+  virtual bool write_stats(const std::string & name);
+
 
 private:
- 
+
+  /**
+  * @brief build the output file name of a run
+  */
+  std::string file_name(unsigned run_number, const char * ext=".cg") const;
+
+  /**
+  * @brief record the nodes of the current event in the statistics (once)
+  */
+  void count_event();
+
+  /**
+  * @brief apply the triggers to the current event, keep its summary and
+  * discard its graph if it is not selected
+  */
+  void select_event();
+
+  /**
+  * @brief get the interned name of a process (cached per process)
+  */
+  name_id process_name(const G4VProcess * proc);
 
   // --------------------------------
   // thread local storage
   node_collection local_data_;
-  std::stack<cg::track *> stack_;
-  unsigned trck_cnt_;
+
+  // graph builder (with the recording policy) and the current step
+  graph_builder builder_;
+  step_record step_;
+
+  // step trace
+  step_recorder trace_;
+
+  // statistics of this thread (NULL if not collected), and whether the
+  // current event is still to be counted
+  std::unique_ptr<build_stats> stats_;
+  bool uncounted_;
+
+  // event selection, the summary of the current event (open until its
+  // end_event()) and the summaries of this thread
+  event_selector selector_;
+  event_summary summary_;
+  bool selected_;
+  bool open_;
+  uint64_t events_;
+  std::vector<event_summary> summaries_;
+
+  // output and allocation options
+  bool streaming_;
+  bool pooled_;
+  io_format format_;
+  compression compression_;
+  bin::vector_coding coding_;
+
+  // interned names of the processes seen by this thread
+  std::unordered_map<const G4VProcess *,name_id> proc_names_;
+
+  // per-event arenas (the current event is last)
+  std::vector<std::unique_ptr<arena> > arenas_;
+
+  // encoded event record (streaming mode)
+  bin::obuffer record_;
 
   // output file base name
   G4String base_name_;
 
+  // copy of the master collection (master thread)
+  node_collection merged_;
+
   // ----------------------------------
-  // static master collection
-  static node_collection event_graphs_;
+  // static master collection and the arenas of its pooled graphs
+  static event_list event_graphs_;
+  static std::vector<std::unique_ptr<arena> > event_arenas_;
+
+  // shared output file and run number (streaming mode)
+  static collection_writer sink_;
+  static unsigned run_number_;
+
+  // statistics and event summaries merged from the threads
+  static build_stats run_stats_;
+  static std::vector<event_summary> run_summaries_;
 
 };
 
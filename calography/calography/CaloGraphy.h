@@ -13,10 +13,26 @@
 
 // --- includes ---
 #include "node.h"
+#include "index.h"
 #include "track.h"
 #include "process.h"
+#include "trajectory.h"
 #include "nodetypes.h"
 #include "CaloGraphyIO.h"
+#include "mapped.h"
+#include "reader.h"
+#include "writer.h"
+#include "compact.h"
+#include "traverse.h"
+#include "event_list.h"
+#include "names.h"
+#include "policy.h"
+#include "builder.h"
+#include "trace.h"
+#include "stats.h"
+#include "trigger.h"
+#include "parallel.h"
+#include "query.h"
 
 
 #endif
@@ -11,6 +11,7 @@
 // --- includes ---
 #include <vector>
 #include <string>
+#include <algorithm>
 #include <fstream>
 #include <cassert>
 #include <iostream>
@@ -18,7 +19,9 @@
 #include "node.h"
 #include "process.h"
 #include "track.h"
+#include "trajectory.h"
 #include "nodetypes.h"
+#include "binio.h"
 
 
 namespace cg {
@@ -28,6 +31,377 @@ namespace cg {
 */
 typedef std::vector<node *> node_collection;
 
+/**
+* @brief on-disk formats
+* @details 
+*  * textFormat: whitespace separated text (the original format)
+*  * binaryFormat: versioned binary format (see binio.h)
+*/
+enum io_format {
+  textFormat,
+  binaryFormat
+};
+
+/**
+* @brief compression of the event records of binary files
+* @details Each event is compressed on its own, so events can still be
+* located through the index and decompressed independently (and in
+* parallel).
+*  * noCompression: events are stored as they are
+*  * fastCompression: favour speed (zlib level 1)
+*  * archiveCompression: favour size (zlib level 9)
+*/
+enum compression {
+  noCompression,
+  fastCompression,
+  archiveCompression
+};
+
+
+namespace bin {
+
+/**
+* @brief write the binary file header.
+*/
+inline void write_header(std::ostream & out, uint32_t flags=0U) {
+  const uint32_t hdr[3] = { version, flags, 0U };
+  out.write(magic,sizeof(magic));
+  out.write(reinterpret_cast<const char *>(hdr),sizeof(hdr));
+}
+
+/**
+* @brief read and check the binary file header.
+* @return false if the stream does not hold a binary graph file this
+* version can read.
+*/
+inline bool read_header(std::istream & in, uint32_t & vers, uint32_t & flags) {
+  char mgc[sizeof(magic)];
+  uint32_t hdr[3];
+  in.read(mgc,sizeof(mgc));
+  in.read(reinterpret_cast<char *>(hdr),sizeof(hdr));
+  if ( !in.good() || std::memcmp(mgc,magic,sizeof(magic)) != 0 )
+    return false;
+  vers = hdr[0];
+  flags = hdr[1];
+  if ( vers == 0U || vers > version ) {
+    std::cerr << "cg: unsupported binary format version " << vers << std::endl;
+    return false;
+  }
+  return true;
+}
+
+/**
+* @brief write a chunk (tag, length and payload).
+*/
+inline void write_chunk(std::ostream & out, uint32_t tag, const char * data, uint64_t n) {
+  out.write(reinterpret_cast<const char *>(&tag),sizeof(tag));
+  out.write(reinterpret_cast<const char *>(&n),sizeof(n));
+  out.write(data,n);
+}
+
+/**
+* @brief read a chunk payload whose length was read from the stream.
+* @details A length larger than the bytes left in the stream (a corrupt
+* file) is refused before the payload is allocated.  Only lengths above
+* checkedPayload are checked, as the check seeks.
+* @return false if the payload is truncated.
+*/
+inline bool read_payload(std::istream & in, uint64_t n, std::vector<char> & payload) {
+  const uint64_t checkedPayload = uint64_t(1U) << 20;
+  if ( n > checkedPayload ) {
+    const std::streampos pos = in.tellg();
+    in.seekg(0,std::ios::end);
+    const std::streampos end = in.tellg();
+    in.seekg(pos);
+    if ( pos < 0 || end < pos || n > uint64_t(end-pos) ) {
+      in.setstate(std::ios::failbit);
+      return false;
+    }
+  }
+  payload.resize(n);
+  in.read(payload.data(),n);
+  return in.good() || ( in.eof() && size_t(in.gcount()) == n );
+}
+
+/**
+* @brief read the next chunk.
+* @return false at the end of the file or if the chunk is truncated.
+*/
+inline bool read_chunk(std::istream & in, uint32_t & tag, std::vector<char> & payload) {
+  uint64_t n;
+  in.read(reinterpret_cast<char *>(&tag),sizeof(tag));
+  in.read(reinterpret_cast<char *>(&n),sizeof(n));
+  if ( !in.good() )
+    return false;
+  return read_payload(in,n,payload);
+}
+
+/**
+* @brief write the vector coding chunk (reduced modes only).
+* @return the number of bytes written
+*/
+inline uint64_t write_coding(std::ostream & out, const vector_coding & coding) {
+  if ( !coding.relative() )
+    return 0U;
+  obuffer buf;
+  buf.put<uint32_t>(coding.mode);
+  buf.put<double>(coding.space);
+  buf.put<double>(coding.time);
+  write_chunk(out,codingTag,buf.data(),buf.size());
+  return chunk_header_size+buf.size();
+}
+
+/**
+* @brief read the payload of a vector coding chunk.
+* @return false if the coding is not understood.
+*/
+inline bool read_coding(const char * data, size_t n, vector_coding & coding) {
+  ibuffer buf(data,n);
+  const uint32_t mode = buf.get<uint32_t>();
+  const double space = buf.get<double>();
+  const double time = buf.get<double>();
+  if ( !buf.good() || mode > fixedDeltas || ( mode == fixedDeltas && !( space > 0. && time > 0. ) ) ) {
+    std::cerr << "cg: unknown vector coding" << std::endl;
+    return false;
+  }
+  coding = vector_coding(static_cast<vector_mode>(mode),space,time);
+  return true;
+}
+
+/**
+* @brief read the vector coding chunk following the header, if any.
+* @details The stream is left after the chunk, or after the header if
+* there is none.
+*/
+inline void read_coding(std::istream & in, vector_coding & coding) {
+  const std::streampos pos = in.tellg();
+  uint32_t tag;
+  std::vector<char> payload;
+  if ( read_chunk(in,tag,payload) && tag == codingTag
+      && read_coding(payload.data(),payload.size(),coding) )
+    return;
+  in.clear();
+  in.seekg(pos);
+}
+
+/**
+* @brief encode an event graph as an event chunk payload.
+* @param[in] nd the event graph
+* @param[in] comp the compression
+* @param[in] coding the coding of the 4-vectors
+* @param[out] buf the chunk payload (cleared first), with the names used
+* by the event
+* @param[out] scratch buffer for the uncompressed payload
+* @return the tag of the chunk, or 0 if a position is out of the range of
+* the coding or the compression fails (buf is then empty and in the fail
+* state)
+*/
+inline uint32_t encode_event(const node * nd, compression comp, const vector_coding & coding, obuffer & buf, obuffer & scratch) {
+  obuffer & rec = comp == noCompression ? buf : scratch;
+  rec.clear();
+  rec.set_coding(coding);
+  nd->write(rec);
+  if ( !rec.good() ) {
+    buf.clear();
+    buf.set_fail();
+    return 0U;
+  }
+  if ( comp == noCompression )
+    return eventTag;
+  if ( !compress(scratch.data(),scratch.size(),comp == archiveCompression ? 9 : 1,buf) ) {
+    buf.set_fail();
+    return 0U;
+  }
+  for ( name_id id : scratch.names() )
+    buf.use_name(id);
+  return compressedEventTag;
+}
+
+/**
+* @brief get the payload of an event chunk, decompressing it if needed.
+* @param[in] tag the chunk tag
+* @param[in] payload the chunk payload
+* @param[out] scratch buffer for decompressed payloads
+* @param[in] vers the format version
+* @return an input buffer over the event payload (empty if the payload
+* can not be decompressed).
+*/
+inline ibuffer event_payload(uint32_t tag, const std::vector<char> & payload, std::vector<char> & scratch, uint32_t vers) {
+  if ( tag != compressedEventTag )
+    return ibuffer(payload.data(),payload.size(),vers);
+  if ( !decompress(payload.data(),payload.size(),scratch) ) {
+    std::cerr << "cg: corrupt compressed event" << std::endl;
+    return ibuffer(NULL,0U,vers);
+  }
+  return ibuffer(scratch.data(),scratch.size(),vers);
+}
+
+/**
+* @brief write name chunks, one per run of consecutive ids.
+* @param[in] out the stream
+* @param[in] ids the name ids, in increasing order
+* @return the number of bytes written
+*/
+inline uint64_t write_name_runs(std::ostream & out, const name_map & ids) {
+  const name_table & table = process_names();
+  uint64_t nbytes = 0U;
+  obuffer buf;
+  for ( size_t i=0; i != ids.size(); ) {
+    size_t last = i+1U;
+    while ( last != ids.size() && ids[last] == ids[last-1U]+1U )
+      last++;
+
+    buf.clear();
+    buf.put<uint32_t>(ids[i]);
+    buf.put<uint32_t>(last-i);
+    for ( ; i != last; i++ )
+      buf.put(table.name(ids[i]));
+    write_chunk(out,namesTag,buf.data(),buf.size());
+    nbytes += chunk_header_size+buf.size();
+  }
+  return nbytes;
+}
+
+/**
+* @brief write the names used by an event which are not written yet.
+* @param[in] out the stream
+* @param[in] used the names used by the event (see obuffer::names())
+* @param[in,out] written a flag for each name id written to the file (updated)
+* @return the number of bytes written (0 if there are no new names)
+*/
+inline uint64_t write_names(std::ostream & out, const name_map & used, std::vector<bool> & written) {
+  name_map ids;
+  for ( name_id id : used ) {
+    if ( id >= written.size() )
+      written.resize(id+1U,false);
+    if ( !written[id] ) {
+      written[id] = true;
+      ids.push_back(id);
+    }
+  }
+  if ( ids.empty() )
+    return 0U;
+
+  std::sort(ids.begin(),ids.end());
+  return write_name_runs(out,ids);
+}
+
+/**
+* @brief read a name chunk.
+* @param[in] payload the chunk payload
+* @param[in,out] names the name ids of the file, extended with the chunk
+*/
+inline bool read_names(ibuffer & payload, name_map & names) {
+  const uint32_t first = payload.get<uint32_t>();
+  const uint32_t n = payload.get<uint32_t>();
+  if ( !payload.good() || uint64_t(first)+n > size_t(name_table::blockSize)*name_table::maxBlocks )
+    return false;
+
+  if ( names.size() < first+n )
+    names.resize(first+n,0U);
+  std::string name;
+  for ( uint32_t i=0; i != n; i++ ) {
+    payload.get(name);
+    names[first+i] = process_names().intern(name);
+  }
+  return payload.good();
+}
+
+/**
+* @brief write the event index, the names of the file and the trailer.
+* @param[in] out the stream, positioned after the last event chunk
+* @param[in] index the offset and length of the event payloads
+* @param[in] written a flag for each name id used by the file
+*/
+inline void write_index(std::ostream & out, const event_index & index, const std::vector<bool> & written) {
+  const uint64_t offset = out.tellp();
+  obuffer buf;
+  buf.put<uint64_t>(index.size());
+  for ( unsigned i=0; i != index.size(); i++ ) {
+    buf.put<uint64_t>(index[i].first);
+    buf.put<uint64_t>(index[i].second);
+  }
+  write_chunk(out,indexTag,buf.data(),buf.size());
+
+  name_map ids;
+  for ( size_t i=0; i != written.size(); i++ )
+    if ( written[i] )
+      ids.push_back(i);
+  write_name_runs(out,ids);
+
+  write_chunk(out,trailerTag,reinterpret_cast<const char *>(&offset),sizeof(offset));
+}
+
+/**
+* @brief read the event index of a file.
+* @param[in] in the stream
+* @param[out] index the offset and length of the event payloads
+* @param[out] names if not NULL, the names of the file (which follow the index)
+* @return false if the file has no index (the stream position is then undefined).
+*/
+inline bool read_index(std::istream & in, event_index & index, name_map * names=NULL) {
+  index.clear();
+
+  // locate the trailer
+  in.clear();
+  in.seekg(0,std::ios::end);
+  const uint64_t fsize = in.tellg();
+  if ( !in.good() || fsize < header_size+trailer_size )
+    return false;
+
+  uint32_t tag;
+  uint64_t len, offset;
+  in.seekg(fsize-trailer_size);
+  in.read(reinterpret_cast<char *>(&tag),sizeof(tag));
+  in.read(reinterpret_cast<char *>(&len),sizeof(len));
+  in.read(reinterpret_cast<char *>(&offset),sizeof(offset));
+  if ( !in.good() || tag != trailerTag || len != sizeof(offset) || offset >= fsize )
+    return false;
+
+  // read the index
+  in.seekg(offset);
+  in.read(reinterpret_cast<char *>(&tag),sizeof(tag));
+  in.read(reinterpret_cast<char *>(&len),sizeof(len));
+  uint64_t n;
+  in.read(reinterpret_cast<char *>(&n),sizeof(n));
+  if ( !in.good() || tag != indexTag || n > (fsize-offset)/(2U*sizeof(uint64_t))
+      || len != sizeof(n)+n*2U*sizeof(uint64_t) )
+    return false;
+
+  index.resize(n);
+  in.read(reinterpret_cast<char *>(index.data()),n*2U*sizeof(uint64_t));
+  if ( !in.good() ) {
+    index.clear();
+    return false;
+  }
+
+  // the names (version 3)
+  std::vector<char> payload;
+  while ( names && read_chunk(in,tag,payload) && tag == namesTag ) {
+    ibuffer buf(payload.data(),payload.size());
+    if ( !read_names(buf,*names) )
+      break;
+  }
+
+  return true;
+}
+
+
+}
+
+
+/**
+* @brief Determine the format of a graph file.
+*/
+inline io_format DetectFormat(const std::string & name) {
+  std::ifstream in(name,std::ios::binary);
+  char mgc[sizeof(bin::magic)];
+  in.read(mgc,sizeof(mgc));
+  if ( in.good() && std::memcmp(mgc,bin::magic,sizeof(mgc)) == 0 )
+    return binaryFormat;
+  return textFormat;
+}
+
 /**
 * @brief Write a collection to a file.
 */
@@ -49,6 +423,58 @@ inline void WriteCollection(const node_collection & nc, const std::string & name
   out.close();
 }
 
+/**
+* @brief Write a collection to a file in a given format.
+* @details Events with a position out of the range of the coding, or
+* which fail to compress, are not written.
+* @param[in] comp compression of the events (binary format only)
+* @param[in] coding coding of the 4-vectors (binary format only)
+* @return false if an event could not be written.
+*/
+inline bool WriteCollection(const node_collection & nc, const std::string & name, io_format fmt,
+    compression comp=noCompression, const bin::vector_coding & coding=bin::vector_coding()) {
+  if ( fmt == textFormat ) {
+    WriteCollection(nc,name);
+    return true;
+  }
+
+  // open a file
+  std::ofstream out;
+  out.open(name,std::ios::binary);
+  bin::write_header(out);
+  uint64_t offset = bin::header_size+bin::write_coding(out,coding);
+
+  // cycle over the collection, one chunk per event
+  bin::obuffer buf, raw;
+  bin::event_index index;
+  std::vector<bool> names;
+  bool ok = true;
+  const unsigned ncs = nc.size();
+  for ( unsigned i=0; i != ncs; i++ ) {
+    const uint32_t tag = bin::encode_event(nc[i],comp,coding,buf,raw);
+    if ( !tag ) {
+      std::cerr << "cg: event " << i << " could not be encoded, not written" << std::endl;
+      ok = false;
+      continue;
+    }
+
+    // new names go ahead of the event
+    offset += bin::write_names(out,buf.names(),names);
+    bin::write_chunk(out,tag,buf.data(),buf.size());
+
+    offset += bin::chunk_header_size;
+    index.push_back(std::make_pair(offset,buf.size()));
+    offset += buf.size();
+  }
+
+  // finish with the event index
+  bin::write_index(out,index,names);
+
+  // close the file
+  out.close();
+  return ok;
+}
+
 
 /**
 * @brief Write a graph to a file.
@@ -66,13 +492,39 @@ inline void WriteGraph(const node * nd, const std::string & name) {
 }
 
 /**
-* @brief Extract a node from a stream.
+* @brief Write a graph to a file in a given format.
 */
-inline node * extract_node(std::istream & stream) {
+inline bool WriteGraph(const node * nd, const std::string & name, io_format fmt,
+    compression comp=noCompression, const bin::vector_coding & coding=bin::vector_coding()) {
+  return WriteCollection(node_collection(1,const_cast<node *>(nd)),name,fmt,comp,coding);
+}
+
+/**
+* @brief Instantiate an empty node of a given type.
+* @return NULL if the type is unknown.
+*/
+inline node * new_node(node_type type) {
+  if ( type == genericNode ) {
+    return new node;
+  } else if ( type == processNode ) {
+    return new process;
+  } else if ( type == trackNode ) {
+    return new track;
+  } else if ( type == trajectoryNode ) {
+    return new trajectory;
+  }
+  return NULL;
+}
+
+/**
+* @brief Instantiate an empty node for the next record of a stream.
+* @return NULL at the end of the stream.
+*/
+inline node * make_node(std::istream & stream) {
 
   // peek ahead to determine the type of node
-  unsigned pos = stream.tellg();
-  unsigned id;
+  std::streampos pos = stream.tellg();
+  node_id id;
   unsigned tmptype;
   stream >> id >> tmptype;
   node_type type = static_cast<node_type>(tmptype);
@@ -83,36 +535,109 @@ inline node * extract_node(std::istream & stream) {
   // step back in stream
   stream.seekg(pos);
 
+  // instantiate the node
+  node *nd = new_node(type);
+  assert(nd);
+
+  return nd;
+}
+
+/**
+* @brief Instantiate an empty node for the next record of a binary buffer.
+* @return NULL if the buffer is exhausted or holds an unknown node type.
+*/
+inline node * make_node(bin::ibuffer & buf) {
+
+  // peek ahead to determine the type of node
+  node_type type = static_cast<node_type>(buf.peek<uint8_t>());
+  if ( buf.eof() || !buf.good() )
+    return NULL;
+
+  return new_node(type);
+}
+
+/**
+* @brief Extract a node from a stream.
+*/
+inline node * extract_node(std::istream & stream) {
+
   // instantiate and extract the node
-  node *nd;
+  node * nd = make_node(stream);
+  if ( nd )
+    nd->deserialize(stream);
 
-  if ( type == genericNode ) {
-    nd = new node;
-  } else if ( type == processNode ) {
-    nd = new process;
-  } else if ( type == trackNode ) {
-    nd = new track;
-  } else {
-    assert(false);
-  }
+  // return the node
+  return nd;
+}
+
+/**
+* @brief Extract a node from a binary buffer.
+* @return NULL if the buffer is exhausted or holds an unknown node type.
+*/
+inline node * extract_node(bin::ibuffer & buf) {
 
-  nd->deserialize(stream);
+  // instantiate and extract the node
+  node * nd = make_node(buf);
+  if ( nd )
+    nd->read(buf);
 
   // return the node
   return nd;
 }
 
 /**
-* @brief Read a collection from a file.
+* @brief Read event graphs from a binary stream.
+* @param[in] in stream positioned at the start of a binary graph file
+* @param[out] nc collection to which the graphs are appended
+* @param[in] max maximum number of graphs to read (0 for all)
 */
-inline node_collection ReadCollection(const std::string & name ) {
-  // open the file
-  std::ifstream in;
-  in.open(name);
+inline void ReadEvents(std::istream & in, node_collection & nc, size_t max=0U) {
+  uint32_t vers, flags;
+  if ( !bin::read_header(in,vers,flags) )
+    return;
+
+  // keep reading event chunks until we reach the end of the file
+  uint32_t tag;
+  std::vector<char> payload, raw;
+  name_map names;
+  bin::vector_coding coding;
+  size_t nread = 0U;
+  while ( (max == 0U || nread != max) && bin::read_chunk(in,tag,payload) ) {
+    if ( tag == bin::namesTag ) {
+      bin::ibuffer buf(payload.data(),payload.size());
+      bin::read_names(buf,names);
+    } else if ( tag == bin::codingTag && !bin::read_coding(payload.data(),payload.size(),coding) )
+      break;
+    if ( !bin::is_event(tag) )
+      continue;
+    bin::ibuffer buf = bin::event_payload(tag,payload,raw,vers);
+    buf.set_names(&names);
+    buf.set_coding(coding);
+    node * nd = extract_node(buf);
+    if ( !nd ) 
+      break;
+    nc.push_back(nd);
+    nread++;
+  }
+}
 
+/**
+* @brief Read a collection from a file in a given format.
+*/
+inline node_collection ReadCollection(const std::string & name, io_format fmt) {
   // create a node collection
   node_collection nc;
 
+  if ( fmt == binaryFormat ) {
+    std::ifstream in(name,std::ios::binary);
+    ReadEvents(in,nc);
+    return nc;
+  }
+
+  // open the file
+  std::ifstream in;
+  in.open(name);
+
   // keep reading graphs until we reach the end of the file
   while ( !in.eof() && in.good() && in.peek() != EOF ) {
     node * nd = extract_node(in);
@@ -129,10 +654,36 @@ inline node_collection ReadCollection(const std::string & name ) {
   
 }
 
+/**
+* @brief Read a collection from a file.
+* @details The format is determined from the file.
+*/
+inline node_collection ReadCollection(const std::string & name ) {
+  return ReadCollection(name,DetectFormat(name));
+}
+
+/**
+* @brief Index each graph of a collection (see node::build_index()).
+* @details Call once after loading to make find() and find_track() on
+* the event roots constant time.
+*/
+inline void IndexCollection(const node_collection & nc) {
+  for ( node * nd : nc )
+    if ( nd )
+      nd->build_index();
+}
+
 /**
 * @brief Read a graph freom a file.
 */
 inline node * ReadGraph(const std::string & name ) {
+  if ( DetectFormat(name) == binaryFormat ) {
+    std::ifstream in(name,std::ios::binary);
+    node_collection nc;
+    ReadEvents(in,nc,1U);
+    return nc.empty() ? NULL : nc[0];
+  }
+
   // open the file
   std::ifstream in;
   in.open(name);
@@ -147,6 +698,81 @@ inline node * ReadGraph(const std::string & name ) {
 
 }
 
+/**
+* @brief Read the graph of a single event from a file.
+* @details Binary files with an event index are read by seeking straight to
+* the event.  Otherwise the preceding events are skipped (binary) or parsed
+* and discarded (text).
+* @param[in] name The file name.
+* @param[in] event The event number (position in the file).
+* @return The graph, or NULL if the event is not in the file.
+*/
+inline node * ReadGraph(const std::string & name, size_t event) {
+
+  if ( DetectFormat(name) == textFormat ) {
+    std::ifstream in;
+    in.open(name);
+    for ( size_t i=0; i != event; i++ ) {
+      if ( in.eof() || !in.good() || in.peek() == EOF )
+        return NULL;
+      delete extract_node(in);
+    }
+    if ( in.eof() || !in.good() || in.peek() == EOF )
+      return NULL;
+    return extract_node(in);
+  }
+
+  std::ifstream in(name,std::ios::binary);
+  uint32_t vers, flags;
+  if ( !bin::read_header(in,vers,flags) )
+    return NULL;
+
+  uint32_t tag;
+  std::vector<char> payload, raw;
+  bin::event_index index;
+  name_map names;
+  bin::vector_coding coding;
+  bin::read_coding(in,coding);
+  if ( bin::read_index(in,index,&names) ) {
+    // seek to the event
+    if ( event >= index.size() )
+      return NULL;
+    in.seekg(index[event].first-bin::chunk_header_size);
+    if ( !bin::read_chunk(in,tag,payload) || !bin::is_event(tag) )
+      return NULL;
+  } else {
+    // no index, hop over the chunk headers
+    in.clear();
+    in.seekg(bin::header_size);
+    size_t i = 0U;
+    uint64_t len;
+    while ( true ) {
+      in.read(reinterpret_cast<char *>(&tag),sizeof(tag));
+      in.read(reinterpret_cast<char *>(&len),sizeof(len));
+      if ( !in.good() )
+        return NULL;
+      if ( tag == bin::namesTag ) {
+        if ( !bin::read_payload(in,len,payload) )
+          return NULL;
+        bin::ibuffer buf(payload.data(),payload.size());
+        bin::read_names(buf,names);
+        continue;
+      }
+      if ( bin::is_event(tag) && i++ == event ) {
+        if ( !bin::read_payload(in,len,payload) )
+          return NULL;
+        break;
+      }
+      in.seekg(len,std::ios::cur);
+    }
+  }
+
+  bin::ibuffer buf = bin::event_payload(tag,payload,raw,vers);
+  buf.set_names(&names);
+  buf.set_coding(coding);
+  return extract_node(buf);
+}
+
 }
 
 #endif
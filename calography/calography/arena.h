@@ -0,0 +1,133 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+/**
+* @file arena.h
+* @author C S Cowden
+* @brief Declare a monotonic memory pool for event graphs.
+*/
+
+// --- includes ---
+#include <cstddef>
+#include <memory_resource>
+
+namespace cg {
+
+/**
+* @brief Monotonic memory pool (arena)
+* @details Memory is handed out from large blocks by bumping a pointer and
+* is only returned all at once by reset() or release().  Nodes (and their
+* child lists and names) are allocated from the current arena of the
+* thread when one is active, see arena::scope.  An event graph built
+* inside an arena can be discarded with reset() without walking the graph
+* or running destructors.  Deleting a pooled node is allowed (the
+* destructor runs, the memory stays in the arena).
+* @code
+*   cg::arena pool;
+*   {
+*     cg::arena::scope s(pool);
+*     cg::node * nd = cg::ReadGraph("run1.cg",12);
+*     ...
+*   }
+*   pool.reset();   // the graph is gone
+* @endcode
+*/
+class arena : public std::pmr::memory_resource {
+public:
+
+  /**
+  * @brief constructor
+  * @param[in] block_size size of the memory blocks requested from the system
+  */
+  explicit arena(size_t block_size=1U<<20);
+
+  /**
+  * @brief destructor (frees all blocks, no destructors are run)
+  */
+  virtual ~arena();
+
+  // the arena is not copyable
+  arena(const arena &) = delete;
+  arena & operator=(const arena &) = delete;
+
+  /**
+  * @brief discard all allocations, the largest block is kept for reuse.
+  */
+  void reset();
+
+  /**
+  * @brief discard all allocations and free all blocks.
+  */
+  void release();
+
+  /**
+  * @brief get the number of bytes handed out since the last reset
+  */
+  size_t used() const { return used_; }
+
+  /**
+  * @brief get the number of bytes held in blocks
+  */
+  size_t capacity() const { return capacity_; }
+
+  /**
+  * @brief get the current arena of this thread (NULL if none)
+  */
+  static arena * current();
+
+  /**
+  * @brief get the memory resource for new allocations on this thread
+  * @details the current arena, or the default resource if none is active.
+  */
+  static std::pmr::memory_resource * resource();
+
+  /**
+  * @brief Make an arena current for the lifetime of the scope.
+  */
+  class scope {
+  public:
+    explicit scope(arena & a);
+    /// a NULL arena leaves the current arena unchanged
+    explicit scope(arena * a);
+    ~scope();
+    scope(const scope &) = delete;
+    scope & operator=(const scope &) = delete;
+  private:
+    arena * prev_;
+  };
+
+protected:
+
+  virtual void * do_allocate(size_t bytes, size_t alignment);
+  virtual void do_deallocate(void *, size_t, size_t) { }
+  virtual bool do_is_equal(const std::pmr::memory_resource & mr) const noexcept { return this == &mr; }
+
+private:
+
+  /**
+  * @brief get a new block large enough for an allocation
+  */
+  void grow(size_t bytes, size_t alignment);
+
+  // block header, the memory follows
+  struct block {
+    block * next;
+    size_t size;
+  };
+
+  // list of blocks, the current one first
+  block * head_;
+
+  // free space in the current block
+  char * cur_;
+  char * end_;
+
+  size_t block_size_;
+  size_t used_;
+  size_t capacity_;
+
+};
+
+}
+
+#endif
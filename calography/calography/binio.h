@@ -0,0 +1,712 @@
+#ifndef BINIO_H
+#define BINIO_H
+
+/**
+* @file binio.h
+* @author C S Cowden
+* @brief Buffers and constants for the binary graph format.
+* @details The binary format is laid out as follows (all values little-endian).
+*  * file header: magic "CGBF", u32 version, u32 flags, u32 reserved
+*  * a sequence of chunks: u32 tag, u64 payload length, payload
+*  * an event chunk holds one graph, written depth-first.  Each node
+*    record is: u8 type, u32 field length, fields, u32 number of children,
+*    followed by the child records.  The fields start with the node id,
+*    a u64 since version 2 (a u32 in version 1 files).  Since version 3
+*    process records hold a u16 name id instead of the name.
+*  * since version 4 a coding chunk may follow the header: u32 vector
+*    mode, f64 space quantum, f64 time quantum (see vector_coding).  In
+*    the reduced modes positions are stored as four 32 bit deltas from
+*    the position of the parent node (step points from the position of
+*    their trajectory) and momenta as four f32.
+*  * since version 5 the number of children of a node record is followed
+*    by a u32 byte length of its child records (unknownLength if it does
+*    not fit), so readers can skip a sub-graph without walking it.
+*  * a compressed event chunk holds one graph compressed independently
+*    of the other events: u8 codec, u64 size of the event payload, then
+*    the compressed payload.
+*  * name chunks map name ids to names: u32 first id, u32 count, then
+*    u16 length and characters for each name.  Name chunks precede the
+*    first event which uses their names; only the names used by the
+*    events of the file are written, one chunk per run of consecutive ids.
+*  * an index chunk after the events: u64 number of events, then u64
+*    payload offset and u64 payload length for each event.
+*  * the index chunk is followed by name chunks with all names of the
+*    file and by a trailer chunk: u64 offset of the index chunk.
+* Readers skip chunks with unknown tags and node fields beyond those they
+* understand, so the format can be extended without breaking old files.
+*/
+
+// --- includes ---
+#include <vector>
+#include <string>
+#include <string_view>
+#include <memory_resource>
+#include <cstring>
+#include <cstdint>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#include "relvec.h"
+#include "nodetypes.h"
+#include "names.h"
+
+namespace cg {
+
+namespace bin {
+
+/**
+* @brief file magic
+*/
+const char magic[4] = { 'C', 'G', 'B', 'F' };
+
+/**
+* @brief current format version
+*/
+const uint32_t version = 5U;
+
+/**
+* @brief size of a node id in the records of a format version
+*/
+constexpr unsigned id_size(uint32_t vers) { return vers < 2U ? 4U : 8U; }
+
+/**
+* @brief size of the part of a node record after the fields (number of
+* children and, since version 5, the length of the child records)
+*/
+constexpr unsigned tail_size(uint32_t vers) { return vers < 5U ? 4U : 8U; }
+
+/**
+* @brief length of child records which does not fit a u32
+*/
+const uint32_t unknownLength = 0xffffffffU;
+
+/**
+* @brief size of the file header in bytes
+*/
+const unsigned header_size = 16U;
+
+/**
+* @brief size of a chunk header (tag and length) in bytes
+*/
+const unsigned chunk_header_size = 12U;
+
+/**
+* @brief build a chunk tag from four characters
+*/
+constexpr uint32_t make_tag(char a, char b, char c, char d) {
+  return uint32_t((unsigned char)a) | uint32_t((unsigned char)b) << 8
+    | uint32_t((unsigned char)c) << 16 | uint32_t((unsigned char)d) << 24;
+}
+
+/**
+* @brief tag of an event (graph) chunk
+*/
+const uint32_t eventTag = make_tag('E','V','N','T');
+
+/**
+* @brief tag of a compressed event chunk
+*/
+const uint32_t compressedEventTag = make_tag('E','V','T','Z');
+
+/**
+* @brief codec of compressed event chunks (zlib deflate)
+*/
+const uint8_t zlibCodec = 1U;
+
+/**
+* @brief size of the header of a compressed event payload (codec and size)
+*/
+const unsigned compressed_header_size = 9U;
+
+/**
+* @brief largest expansion of deflate data (about 1032:1), which bounds the
+* uncompressed size accepted from a compressed event payload
+*/
+const uint64_t max_deflate_ratio = 1032U;
+
+/**
+* @brief check if a chunk tag is an event (compressed or not)
+*/
+inline bool is_event(uint32_t tag) { return tag == eventTag || tag == compressedEventTag; }
+
+/**
+* @brief tag of the vector coding chunk
+*/
+const uint32_t codingTag = make_tag('C','O','D','E');
+
+/**
+* @brief tag of the event index chunk
+*/
+const uint32_t indexTag = make_tag('I','N','D','X');
+
+/**
+* @brief tag of the name chunk
+*/
+const uint32_t namesTag = make_tag('N','A','M','E');
+
+/**
+* @brief tag of the trailer chunk
+*/
+const uint32_t trailerTag = make_tag('T','R','L','R');
+
+/**
+* @brief size of the trailer chunk in bytes
+*/
+const unsigned trailer_size = chunk_header_size+8U;
+
+/**
+* @brief offset and length of each event payload in a file
+*/
+typedef std::vector<std::pair<uint64_t,uint64_t> > event_index;
+
+
+/**
+* @brief storage modes of positions and momenta
+*  * fullVectors: four f64 (lossless)
+*  * floatDeltas: position deltas and momenta as f32
+*  * fixedDeltas: positions rounded to multiples of the quanta, stored as
+*    i32 deltas in quanta; momenta as f32
+*/
+enum vector_mode {
+  fullVectors,
+  floatDeltas,
+  fixedDeltas
+};
+
+/**
+* @brief Coding of the 4-vectors of a file
+* @details In the reduced modes a position is stored relative to a
+* reference, the position of the parent node as it is read back, so the
+* rounding errors do not accumulate down the graph.  Fixed-point positions
+* are rounded to multiples of the quanta: the error is at most half a
+* quantum and a node must stay within 2^31 quanta of its parent, a record
+* which does not fails to be written.
+*/
+struct vector_coding {
+
+  /**
+  * @brief construct with a mode and the quanta (fixed-point only)
+  */
+  explicit vector_coding(vector_mode m=fullVectors, double s=0., double t=0.)
+    :mode(m)
+    ,space(s)
+    ,time(t)
+  { assert(mode != fixedDeltas || ( space > 0. && time > 0. )); }
+
+  /**
+  * @brief fixed-point coding with a given number of bits over the detector
+  * @param[in] extent largest absolute coordinate (mm)
+  * @param[in] duration largest absolute time (ns)
+  * @param[in] bits bits per coordinate (at most 29, nodes at -extent and
+  * +extent are 2^(bits+1) quanta apart)
+  */
+  static vector_coding fixed_point(double extent, double duration, unsigned bits=24U) {
+    assert(bits <= 29U);
+    return vector_coding(fixedDeltas,std::ldexp(extent,-int(bits)),std::ldexp(duration,-int(bits)));
+  }
+
+  /**
+  * @brief check if positions are stored relative to a reference
+  */
+  bool relative() const { return mode != fullVectors; }
+
+  /**
+  * @brief number of bytes of a stored 4-vector
+  */
+  unsigned size() const { return mode == fullVectors ? 32U : 16U; }
+
+  /**
+  * @brief the position as it is read back
+  */
+  relvec rounded(const relvec & v, const relvec & ref) const {
+    if ( mode == floatDeltas )
+      return relvec(ref.t_+float(v.t_-ref.t_),ref.x_+float(v.x_-ref.x_),
+          ref.y_+float(v.y_-ref.y_),ref.z_+float(v.z_-ref.z_));
+    if ( mode == fixedDeltas )
+      return relvec(round(v.t_,time),round(v.x_,space),round(v.y_,space),round(v.z_,space));
+    return v;
+  }
+
+  /**
+  * @brief store a position relative to a reference (reduced modes)
+  * @return false if a fixed-point delta is out of the range of i32
+  */
+  bool encode(const relvec & v, const relvec & ref, char * p) const {
+    if ( mode == floatDeltas ) {
+      const float d[4] = { float(v.t_-ref.t_), float(v.x_-ref.x_), float(v.y_-ref.y_), float(v.z_-ref.z_) };
+      std::memcpy(p,d,sizeof(d));
+      return true;
+    }
+
+    const int64_t d64[4] = { delta(v.t_,ref.t_,time), delta(v.x_,ref.x_,space),
+      delta(v.y_,ref.y_,space), delta(v.z_,ref.z_,space) };
+    int32_t d[4];
+    bool ok = true;
+    for ( unsigned k=0; k != 4U; k++ ) {
+      ok = ok && d64[k] >= std::numeric_limits<int32_t>::min() && d64[k] <= std::numeric_limits<int32_t>::max();
+      d[k] = ok ? int32_t(d64[k]) : 0;
+    }
+    std::memcpy(p,d,sizeof(d));
+    return ok;
+  }
+
+  /**
+  * @brief read a position stored relative to a reference (reduced modes)
+  */
+  relvec decode(const char * p, const relvec & ref) const {
+    if ( mode == floatDeltas ) {
+      float d[4];
+      std::memcpy(d,p,sizeof(d));
+      return relvec(ref.t_+d[0],ref.x_+d[1],ref.y_+d[2],ref.z_+d[3]);
+    }
+    int32_t d[4];
+    std::memcpy(d,p,sizeof(d));
+    return relvec((quanta(ref.t_,time)+d[0])*time,(quanta(ref.x_,space)+d[1])*space,
+        (quanta(ref.y_,space)+d[2])*space,(quanta(ref.z_,space)+d[3])*space);
+  }
+
+  // the mode and the quanta (mm and ns)
+  vector_mode mode;
+  double space;
+  double time;
+
+private:
+
+  static int64_t quanta(double x, double q) { return std::llround(x/q); }
+
+  // difference in quanta (out of the range of i32 if either is too large
+  // for a quantum count)
+  static int64_t delta(double x, double ref, double q) {
+    const double lim = std::ldexp(1.,62);
+    if ( !(std::fabs(x/q) < lim) || !(std::fabs(ref/q) < lim) )
+      return std::numeric_limits<int64_t>::max();
+    return quanta(x,q)-quanta(ref,q);
+  }
+  static double round(double x, double q) { return quanta(x,q)*q; }
+};
+
+
+/**
+* @brief Output buffer
+* @details Accumulate a binary record in memory.  Fields are appended
+* with their native (little-endian) representation.
+*/
+class obuffer {
+public:
+
+  /**
+  * @brief default constructor
+  */
+  obuffer():fail_(false),origin_(0.,0.,0.,0.) { }
+
+  /**
+  * @brief append raw bytes
+  */
+  inline void append(const void * data, size_t n) {
+    const size_t sz = buf_.size();
+    buf_.resize(sz+n);
+    std::memcpy(&buf_[sz],data,n);
+  }
+
+  /**
+  * @brief append a fixed width value
+  */
+  template<typename T>
+  inline void put(const T & val) { append(&val,sizeof(T)); }
+
+  /**
+  * @brief append a string (u16 length followed by the characters)
+  */
+  inline void put(std::string_view str) {
+    assert(str.size() < 0x10000);
+    put<uint16_t>(str.size());
+    append(str.data(),str.size());
+  }
+  inline void put(const std::string & str) { put(std::string_view(str)); }
+  inline void put(const std::pmr::string & str) { put(std::string_view(str)); }
+
+  /**
+  * @brief append a name id (u16), recording that the name is used
+  */
+  inline void put_name(name_id id) {
+    put<uint16_t>(id);
+    use_name(id);
+  }
+
+  /**
+  * @brief record that a name is used
+  */
+  inline void use_name(name_id id) {
+    if ( id >= used_.size() )
+      used_.resize(id+1U,false);
+    if ( !used_[id] ) {
+      used_[id] = true;
+      names_.push_back(id);
+    }
+  }
+
+  /**
+  * @brief get the ids of the names used by the record, in order of use
+  */
+  const name_map & names() const { return names_; }
+
+  /**
+  * @brief append a 4-vector (four f64)
+  */
+  inline void put(const relvec & vec) {
+    const double v[4] = { vec.t_, vec.x_, vec.y_, vec.z_ };
+    append(v,sizeof(v));
+  }
+
+  /**
+  * @brief append a position relative to a reference (see vector_coding)
+  */
+  inline void put_pos(const relvec & vec, const relvec & ref) {
+    if ( !coding_.relative() ) {
+      put(vec);
+      return;
+    }
+    char d[16];
+    if ( !coding_.encode(vec,ref,d) )
+      fail_ = true;
+    append(d,sizeof(d));
+  }
+
+  /**
+  * @brief append a momentum
+  */
+  inline void put_momentum(const relvec & vec) {
+    if ( !coding_.relative() ) {
+      put(vec);
+      return;
+    }
+    const float v[4] = { float(vec.t_), float(vec.x_), float(vec.y_), float(vec.z_) };
+    append(v,sizeof(v));
+  }
+
+  /**
+  * @brief set the coding of the 4-vectors
+  */
+  void set_coding(const vector_coding & coding) { coding_ = coding; }
+  const vector_coding & coding() const { return coding_; }
+
+  /**
+  * @brief set the reference position of the node being written
+  * (the position of its parent as it is read back)
+  */
+  void set_origin(const relvec & origin) { origin_ = origin; }
+  const relvec & origin() const { return origin_; }
+
+  /**
+  * @brief overwrite a fixed width value at a given offset
+  */
+  template<typename T>
+  inline void put_at(size_t offset, const T & val) {
+    assert(offset+sizeof(T) <= buf_.size());
+    std::memcpy(&buf_[offset],&val,sizeof(T));
+  }
+
+  /**
+  * @brief get the number of bytes in the buffer
+  */
+  size_t size() const { return buf_.size(); }
+
+  /**
+  * @brief get the data
+  */
+  const char * data() const { return buf_.data(); }
+  char * data() { return buf_.data(); }
+
+  /**
+  * @brief resize the buffer (new bytes are zero)
+  */
+  void resize(size_t n) { buf_.resize(n); }
+
+  /**
+  * @brief clear the buffer (keeps the allocated memory), the fail state
+  * and the names used
+  */
+  void clear() {
+    buf_.clear();
+    fail_ = false;
+    for ( name_id id : names_ )
+      used_[id] = false;
+    names_.clear();
+  }
+
+  /**
+  * @brief check that every field could be stored (positions may be out
+  * of the range of the fixed-point coding)
+  */
+  bool good() const { return !fail_; }
+
+  /**
+  * @brief set the fail state
+  */
+  void set_fail() { fail_ = true; }
+
+private:
+
+  // the data
+  std::vector<char> buf_;
+  bool fail_;
+
+  // the names used, and a flag for each id
+  name_map names_;
+  std::vector<bool> used_;
+
+  // coding of the 4-vectors and reference position
+  vector_coding coding_;
+  relvec origin_;
+
+};
+
+
+/**
+* @brief Input buffer
+* @details Read fields from a block of memory.  The buffer does not own
+* the memory.  Reading past the end sets the fail state (like a stream)
+* and returns zeros.
+*/
+class ibuffer {
+public:
+
+  /**
+  * @brief construct over a block of memory
+  * @param[in] data pointer to the first byte
+  * @param[in] n number of bytes
+  * @param[in] vers format version of the records in the buffer
+  */
+  ibuffer(const char * data, size_t n, uint32_t vers=bin::version)
+    :begin_(data)
+    ,cur_(data)
+    ,end_(data+n)
+    ,fail_(false)
+    ,version_(vers)
+    ,names_(NULL)
+    ,origin_(0.,0.,0.,0.)
+  { }
+
+  /**
+  * @brief get the format version of the records
+  */
+  uint32_t version() const { return version_; }
+
+  /**
+  * @brief read a node id (stored as a u32 before version 2)
+  */
+  inline node_id get_id() {
+    return version_ < 2U ? node_id(get<uint32_t>()) : get<uint64_t>();
+  }
+
+  /**
+  * @brief set the map of the name ids of the records to the name table
+  * @details Without a map the ids are taken to be those of the name table.
+  */
+  void set_names(const name_map * names) { names_ = names; }
+
+  /**
+  * @brief read a name id and map it to the name table
+  */
+  inline name_id get_name() {
+    const name_id id = get<uint16_t>();
+    if ( !names_ )
+      return id;
+    return id < names_->size() ? (*names_)[id] : 0U;
+  }
+
+  /**
+  * @brief read raw bytes
+  */
+  inline bool read(void * data, size_t n) {
+    if ( fail_ || size_t(end_-cur_) < n ) {
+      fail_ = true;
+      std::memset(data,0,n);
+      return false;
+    }
+    std::memcpy(data,cur_,n);
+    cur_ += n;
+    return true;
+  }
+
+  /**
+  * @brief read a fixed width value
+  */
+  template<typename T>
+  inline T get() {
+    T val;
+    read(&val,sizeof(T));
+    return val;
+  }
+
+  /**
+  * @brief read a string
+  */
+  inline void get(std::string & str) { get_string(str); }
+  inline void get(std::pmr::string & str) { get_string(str); }
+
+  /**
+  * @brief read a 4-vector
+  */
+  inline void get(relvec & vec) {
+    double v[4];
+    read(v,sizeof(v));
+    vec.t_ = v[0]; vec.x_ = v[1]; vec.y_ = v[2]; vec.z_ = v[3];
+  }
+
+  /**
+  * @brief read a position stored relative to a reference
+  */
+  inline void get_pos(relvec & vec, const relvec & ref) {
+    if ( !coding_.relative() ) {
+      get(vec);
+      return;
+    }
+    char d[16];
+    read(d,sizeof(d));
+    vec = fail_ ? relvec(0.,0.,0.,0.) : coding_.decode(d,ref);
+  }
+
+  /**
+  * @brief read a momentum
+  */
+  inline void get_momentum(relvec & vec) {
+    if ( !coding_.relative() ) {
+      get(vec);
+      return;
+    }
+    float v[4];
+    read(v,sizeof(v));
+    vec.t_ = v[0]; vec.x_ = v[1]; vec.y_ = v[2]; vec.z_ = v[3];
+  }
+
+  /**
+  * @brief set the coding of the 4-vectors
+  */
+  void set_coding(const vector_coding & coding) { coding_ = coding; }
+  const vector_coding & coding() const { return coding_; }
+
+  /**
+  * @brief set the reference position of the node being read
+  */
+  void set_origin(const relvec & origin) { origin_ = origin; }
+  const relvec & origin() const { return origin_; }
+
+  /**
+  * @brief peek at a fixed width value without consuming it
+  */
+  template<typename T>
+  inline T peek() const {
+    T val;
+    if ( fail_ || size_t(end_-cur_) < sizeof(T) )
+      std::memset(&val,0,sizeof(T));
+    else
+      std::memcpy(&val,cur_,sizeof(T));
+    return val;
+  }
+
+  /**
+  * @brief skip bytes
+  */
+  inline void skip(size_t n) {
+    if ( fail_ || size_t(end_-cur_) < n ) {
+      fail_ = true;
+      cur_ = end_;
+    } else
+      cur_ += n;
+  }
+
+  /**
+  * @brief get the current offset from the start of the buffer
+  */
+  size_t tell() const { return cur_-begin_; }
+
+  /**
+  * @brief move to an offset from the start of the buffer
+  */
+  inline void seek(size_t offset) {
+    if ( offset > size_t(end_-begin_) ) {
+      fail_ = true;
+      cur_ = end_;
+    } else
+      cur_ = begin_+offset;
+  }
+
+  /**
+  * @brief get a pointer to the current position
+  */
+  const char * ptr() const { return cur_; }
+
+  /**
+  * @brief get the number of unread bytes
+  */
+  size_t remaining() const { return end_-cur_; }
+
+  /**
+  * @brief check the buffer state
+  */
+  bool good() const { return !fail_; }
+
+  /**
+  * @brief check if the buffer is exhausted
+  */
+  bool eof() const { return cur_ == end_; }
+
+private:
+
+  template<typename S>
+  inline void get_string(S & str) {
+    const uint16_t n = get<uint16_t>();
+    if ( fail_ || size_t(end_-cur_) < n ) {
+      fail_ = true;
+      str.clear();
+      return;
+    }
+    str.assign(cur_,n);
+    cur_ += n;
+  }
+
+  const char * begin_;
+  const char * cur_;
+  const char * end_;
+  bool fail_;
+
+  // format version
+  uint32_t version_;
+
+  // name ids of the records
+  const name_map * names_;
+
+  // coding of the 4-vectors and reference position
+  vector_coding coding_;
+  relvec origin_;
+
+};
+
+/**
+* @brief compress an event payload (zlib).
+* @param[in] data the event payload
+* @param[in] n the size of the payload
+* @param[in] level the compression level (1 fastest, 9 smallest)
+* @param[out] out the compressed event payload (cleared first)
+* @return false if the payload can not be compressed.
+*/
+bool compress(const char * data, size_t n, int level, obuffer & out);
+
+/**
+* @brief decompress an event payload.
+* @param[in] data the compressed event payload
+* @param[in] n the size of the compressed payload
+* @param[out] out the event payload
+* @return false if the payload is corrupt or uses an unknown codec.  The
+* size in the header is checked against max_deflate_ratio before the event
+* payload is allocated.
+*/
+bool decompress(const char * data, size_t n, std::vector<char> & out);
+
+}
+
+}
+
+#endif
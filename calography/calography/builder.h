@@ -0,0 +1,187 @@
+#ifndef BUILDER_H
+#define BUILDER_H
+
+/**
+* @file builder.h
+* @author C S Cowden
+* @brief Declare the graph builder (event graphs from a sequence of steps).
+*/
+
+// --- includes ---
+#include <vector>
+#include <stack>
+#include <cstdint>
+
+#include "node.h"
+#include "track.h"
+#include "process.h"
+#include "trajectory.h"
+#include "policy.h"
+#include "names.h"
+
+namespace cg {
+
+/**
+* @brief status of a track after a step (the values of G4TrackStatus)
+*/
+enum track_status {
+  trackAlive,
+  trackStopButAlive,
+  trackStopAndKill,
+  trackKillTrackAndSecondaries,
+  trackSuspend,
+  trackPostponeToNextEvent
+};
+
+/**
+* @brief a secondary produced in a step
+*/
+struct step_secondary {
+  int pdg;           // particle code
+  relvec mom;        // total energy and momentum
+};
+
+/**
+* @brief the fields of a G4Step used to build a graph
+* @details A stand-in for G4Step, filled by CGG4Interface or read back
+* from a step trace (see trace.h).  Energies and momenta are 4-vectors of
+* the total energy and the momentum, positions of the time and position.
+*/
+struct step_record {
+  int track_id;          // Geant4 track id
+  int pdg;               // particle code
+  uint8_t status;        // track status after the step (track_status)
+  relvec pre_pos;        // pre-step point
+  relvec pre_mom;
+  relvec post_pos;       // post-step point
+  relvec post_mom;
+  name_id process;       // process limiting the step (see process_names())
+  double edep;           // energy deposited in the step
+  std::vector<step_secondary> secondaries;
+
+  /**
+  * @brief check if the track continues after the step
+  */
+  bool alive() const { return status == trackAlive || status == trackStopButAlive; }
+};
+
+
+/**
+* @brief Graph builder
+* @details Builds the graph of an event from its steps, in the order
+* Geant4 processes them (secondaries are expected to be processed on a
+* stack).  The first step of track 1 on an empty stack starts the root.
+* The recording policy decides which steps and secondaries are recorded
+* (see policy.h); with trajectories each particle is recorded as a
+* trajectory node holding its step points.  Nodes are allocated from the
+* current arena of the thread (see arena.h).  The builder does not own the
+* graph.
+*/
+class graph_builder {
+public:
+
+  /**
+  * @brief constructor
+  */
+  graph_builder();
+
+  /**
+  * @brief start a new event (forget the graph and the track stack)
+  */
+  void start_event();
+
+  /**
+  * @brief add a step to the graph
+  */
+  void process_step(const step_record & st);
+
+  // --- getters ---
+
+  /**
+  * @brief get the root of the graph of this event (NULL before the first step)
+  */
+  track * root() const { return root_; }
+
+  /**
+  * @brief get the number of nodes created in this event
+  */
+  uint64_t nodes() const { return nodes_; }
+
+  /**
+  * @brief get the number of tracks waiting on the stack
+  */
+  size_t stack_size() const { return stack_.size(); }
+
+  /**
+  * @brief check if particles are recorded as trajectories
+  */
+  bool trajectories() const { return trajectories_; }
+
+  /**
+  * @brief check if graphs are indexed as they are built
+  */
+  bool indexed() const { return indexed_; }
+
+  /**
+  * @brief get the recording policy (may be modified between events)
+  */
+  recording_policy & policy() { return policy_; }
+  const recording_policy & policy() const { return policy_; }
+
+  // --- setters ---
+
+  /**
+  * @brief record particles as trajectories (step points in one node)
+  */
+  void set_trajectories(bool trj) { trajectories_ = trj; }
+
+  /**
+  * @brief index graphs as they are built (see node::build_index())
+  */
+  void set_indexed(bool idx) { indexed_ = idx; }
+
+  /**
+  * @brief set the recording policy
+  */
+  void set_policy(const recording_policy & pol) { policy_ = pol; }
+
+private:
+
+  /**
+  * @brief a track waiting on the stack
+  */
+  struct stack_entry {
+    // the track node (the recorded track above the track if it is not recorded)
+    track * node;
+    // Geant4 track id and generation
+    unsigned g4id;
+    unsigned depth;
+    // is the track recorded
+    bool recorded;
+    // energy deposited in the node so far
+    double edep;
+  };
+
+  /**
+  * @brief create a track (or trajectory) node
+  */
+  track * new_track(int pdg, unsigned g4id, const relvec & mom, const relvec & pos);
+
+  // tracks waiting to be processed
+  std::stack<stack_entry> stack_;
+  unsigned trck_cnt_;
+
+  // root of the graph of this event and the number of its nodes
+  track * root_;
+  uint64_t nodes_;
+
+  // recording options
+  recording_policy policy_;
+  bool trajectories_;
+  bool indexed_;
+
+};
+
+}
+
+#endif
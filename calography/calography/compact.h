@@ -0,0 +1,190 @@
+#ifndef COMPACT_H
+#define COMPACT_H
+
+/**
+* @file compact.h
+* @author C S Cowden
+* @brief Declare a compact, columnar representation of a graph.
+*/
+
+// --- includes ---
+#include <vector>
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+#include "relvec.h"
+#include "nodetypes.h"
+
+namespace cg {
+
+class node;
+class node_view;
+
+/**
+* @brief Compact graph
+* @details The nodes of a graph are stored in depth-first (pre-)order in
+* structure-of-arrays columns.  The sub-graph below node i is the
+* contiguous index range [i, end(i)), so whole-shower scans are simple
+* loops over columns.  Children are stored in compressed sparse row form
+* (child_offsets/child_index) and each node records its parent (-1 for
+* the root) and depth.  Process names are stored once; process nodes hold
+* an index into names() (-1 for other node types).  Tracks hold the total
+* energy of the particle (the time component of the momentum, 0 for other
+* node types).
+*/
+class compact_graph {
+public:
+
+  /**
+  * @brief index type of the nodes
+  */
+  typedef uint32_t index;
+
+  /**
+  * @brief default constructor (empty graph)
+  */
+  compact_graph() { }
+
+  /**
+  * @brief build from a node tree
+  */
+  explicit compact_graph(const node * root) { build(root); }
+
+  /**
+  * @brief build from a mapped node record
+  */
+  explicit compact_graph(const node_view & root) { build(root); }
+
+  /**
+  * @brief build from a node tree (replaces the contents)
+  */
+  void build(const node * root);
+
+  /**
+  * @brief build from a mapped node record (replaces the contents)
+  */
+  void build(const node_view & root);
+
+  /**
+  * @brief remove all nodes
+  */
+  void clear();
+
+  /**
+  * @brief get the number of nodes
+  */
+  size_t size() const { return type_.size(); }
+
+  // --- per node accessors ---
+
+  node_id id(index i) const { return id_[i]; }
+  node_type type(index i) const { return static_cast<node_type>(type_[i]); }
+  float energy(index i) const { return energy_[i]; }
+  double track_energy(index i) const { return etot_[i]; }
+  relvec pos(index i) const { return relvec(t_[i],x_[i],y_[i],z_[i]); }
+  int pdg(index i) const { return pdg_[i]; }
+  unsigned G4TrackID(index i) const { return g4trackid_[i]; }
+  int process_id(index i) const { return proc_[i]; }
+  std::string_view name(index i) const { return proc_[i] < 0 ? std::string_view() : std::string_view(names_[proc_[i]]); }
+  int32_t parent(index i) const { return parent_[i]; }
+  uint32_t depth(index i) const { return depth_[i]; }
+
+  /**
+  * @brief end of the sub-graph below node i (one past the last node)
+  */
+  index end(index i) const { return end_[i]; }
+
+  /**
+  * @brief number of children of node i
+  */
+  uint32_t nchildren(index i) const { return child_offsets_[i+1]-child_offsets_[i]; }
+
+  /**
+  * @brief the children of node i (pointers into child_index())
+  */
+  const index * children_begin(index i) const { return child_index_.data()+child_offsets_[i]; }
+  const index * children_end(index i) const { return child_index_.data()+child_offsets_[i+1]; }
+
+  // --- columns ---
+
+  const std::vector<node_id> & ids() const { return id_; }
+  const std::vector<uint8_t> & types() const { return type_; }
+  const std::vector<float> & energies() const { return energy_; }
+  const std::vector<double> & track_energies() const { return etot_; }
+  const std::vector<double> & t() const { return t_; }
+  const std::vector<double> & x() const { return x_; }
+  const std::vector<double> & y() const { return y_; }
+  const std::vector<double> & z() const { return z_; }
+  const std::vector<int32_t> & pdgs() const { return pdg_; }
+  const std::vector<uint32_t> & G4TrackIDs() const { return g4trackid_; }
+  const std::vector<int32_t> & process_ids() const { return proc_; }
+  const std::vector<int32_t> & parents() const { return parent_; }
+  const std::vector<uint32_t> & depths() const { return depth_; }
+  const std::vector<index> & ends() const { return end_; }
+  const std::vector<uint32_t> & child_offsets() const { return child_offsets_; }
+  const std::vector<index> & child_index() const { return child_index_; }
+  const std::vector<std::string> & names() const { return names_; }
+
+  // --- analysis methods ---
+
+  /**
+  * @brief sum the energy of the sub-graph below node i
+  */
+  double totalenergy(index i=0) const;
+
+  /**
+  * @brief find a node by id
+  * @return the index of the node, or -1 if it is not found
+  */
+  int64_t find(node_id id) const;
+
+  /**
+  * @brief find the index of a process name
+  * @return the index in names(), or -1 if no node uses the name
+  */
+  int32_t process_index(std::string_view name) const;
+
+private:
+
+  /**
+  * @brief append a node (parent links and depths are set by the caller)
+  */
+  void push(node_id id, node_type type, float E, const relvec & pos,
+    int pdg, unsigned g4trackid, double etot, int32_t proc);
+
+  /**
+  * @brief get the index of a process name, adding it if needed (-1 for other node types)
+  */
+  int32_t intern(node_type type, std::string_view name);
+
+  /**
+  * @brief compute the sub-graph ends and child lists from the parents
+  */
+  void finish();
+
+  // node columns
+  std::vector<node_id> id_;
+  std::vector<uint8_t> type_;
+  std::vector<float> energy_;
+  std::vector<double> etot_;
+  std::vector<double> t_, x_, y_, z_;
+  std::vector<int32_t> pdg_;
+  std::vector<uint32_t> g4trackid_;
+  std::vector<int32_t> proc_;
+
+  // structure
+  std::vector<int32_t> parent_;
+  std::vector<uint32_t> depth_;
+  std::vector<index> end_;
+  std::vector<uint32_t> child_offsets_;
+  std::vector<index> child_index_;
+
+  // process names
+  std::vector<std::string> names_;
+
+};
+
+}
+
+#endif
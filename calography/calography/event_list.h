@@ -0,0 +1,143 @@
+#ifndef EVENT_LIST_H
+#define EVENT_LIST_H
+
+/**
+* @file event_list.h
+* @author C S Cowden
+* @brief Declare a concurrent, append-only list of event graphs.
+*/
+
+// --- includes ---
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cg {
+
+class node;
+
+/**
+* @brief Concurrent, append-only list of event graphs
+* @details Threads append graphs without a lock and without waiting for
+* each other: a range of slots is reserved with one atomic add and filled,
+* each slot being marked ready once written.  An appender then moves the
+* published size over the ready slots which follow it, including those of
+* later ranges whose appenders found an earlier range still being filled.
+* So size() always covers a fully written prefix and readers may call
+* size() and operator[] while other threads append.
+*
+* The slots live in segments which are allocated on demand and never
+* moved; segment k holds segmentSize*2^k slots.  The list does not own the
+* graphs (like node_collection).
+*/
+class event_list {
+public:
+
+  /**
+  * @brief default constructor (empty list)
+  */
+  event_list();
+
+  /**
+  * @brief destructor (frees the segments, not the graphs)
+  */
+  ~event_list();
+
+  // the list is not copyable
+  event_list(const event_list &) = delete;
+  event_list & operator=(const event_list &) = delete;
+
+  /**
+  * @brief append a graph
+  */
+  void push_back(node * nd) { append(&nd,1U); }
+
+  /**
+  * @brief append several graphs as one contiguous range
+  * @param[in] nds the graphs
+  * @param[in] n number of graphs
+  */
+  void append(node * const * nds, size_t n);
+
+  /**
+  * @brief append a collection of graphs as one contiguous range
+  */
+  void append(const std::vector<node *> & nds) { append(nds.data(),nds.size()); }
+
+  /**
+  * @brief get the number of published graphs
+  */
+  size_t size() const { return published_.load(std::memory_order_acquire); }
+
+  /**
+  * @brief check for no published graphs
+  */
+  bool empty() const { return size() == 0U; }
+
+  /**
+  * @brief get a published graph (i < size())
+  */
+  node * operator[](size_t i) const;
+
+  /**
+  * @brief copy the published graphs to a collection
+  * @param[out] nds collection which is replaced by the published graphs
+  */
+  void copy(std::vector<node *> & nds) const;
+
+  /**
+  * @brief remove all graphs (not thread-safe)
+  */
+  void clear();
+
+  /// number of slots in the first segment
+  static const size_t segmentSize = 1024U;
+
+  /// maximum number of segments
+  static const unsigned maxSegments = 32U;
+
+private:
+
+  /**
+  * @brief a slot, ready once the graph is written
+  */
+  struct slot {
+    node * nd;
+    std::atomic<bool> ready;
+  };
+
+  /**
+  * @brief find the segment and offset of a slot
+  */
+  static void locate(size_t i, unsigned & seg, size_t & offset);
+
+  /**
+  * @brief get a segment, allocating it if needed
+  */
+  slot * segment(unsigned seg);
+
+  /**
+  * @brief check if a slot is written
+  */
+  bool ready(size_t i) const;
+
+  /**
+  * @brief publish the ready slots which follow the published ones
+  */
+  void publish();
+
+  // segments of slots
+  std::atomic<slot *> segments_[maxSegments];
+
+  // number of reserved slots
+  std::atomic<size_t> reserved_;
+
+  // number of published slots
+  std::atomic<size_t> published_;
+
+};
+
+}
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+/**
+* @file index.h
+* @author C S Cowden
+* @brief Declare the id to node index of an event graph.
+*/
+
+// --- includes ---
+#include <cstddef>
+#include <memory_resource>
+#include <unordered_map>
+#include <vector>
+
+#include "nodetypes.h"
+
+namespace cg {
+
+class node;
+class track;
+
+/**
+* @brief list of the track nodes of one Geant4 track
+*/
+typedef std::pmr::vector<track *> track_list;
+
+/**
+* @brief Hash index of the nodes of a sub-graph
+* @details Maps node ids to nodes and Geant4 track ids to the track (and
+* trajectory) nodes of the track, so lookups take constant time.  An index
+* is built for a node with node::build_index() and is owned by that node
+* (its root).  Each indexed node points to the index, so add_child() on any
+* node of the sub-graph adds the new nodes as well; this keeps the index
+* of a graph built by process_step() or expanded by a lazy_graph up to date.
+* The indexes owned by nodes of an inserted sub-graph are destroyed, their
+* nodes belong to this index instead.  The tables are allocated from the
+* memory resource of the root, so a pooled graph and its index are
+* released together with the arena.
+*
+* If ids repeat, find() returns the node indexed first under the id, in
+* the order of insertion (depth-first within a sub-graph indexed at once).
+* The track nodes of a Geant4 track are kept in the order they were
+* indexed, which is the order of the graph (the first is where the
+* particle starts).  Ids changed after a node is indexed are not seen by
+* the index.
+*/
+class node_index {
+public:
+
+  /**
+  * @brief construct an empty index
+  * @param[in] root the node owning the index
+  * @param[in] res memory resource of the tables
+  */
+  node_index(node * root, std::pmr::memory_resource * res);
+
+  // the index is not copyable
+  node_index(const node_index &) = delete;
+  node_index & operator=(const node_index &) = delete;
+
+  /**
+  * @brief add the sub-graph below a node
+  */
+  void insert(node * nd);
+
+  /**
+  * @brief detach the indexed nodes (all nodes of the graph of the root,
+  * whether their ids repeat or not) and remove them
+  */
+  void clear();
+
+  /**
+  * @brief look up a node id
+  * @return the node (NULL if the id is not indexed)
+  */
+  node * find(node_id id) const {
+    auto it = ids_.find(id);
+    return it != ids_.end() ? it->second : NULL;
+  }
+
+  /**
+  * @brief look up the first track node of a Geant4 track
+  * @return the node (NULL if the track is not indexed)
+  */
+  track * find_track(unsigned g4id) const {
+    auto it = tracks_.find(g4id);
+    return it != tracks_.end() ? it->second.front() : NULL;
+  }
+
+  /**
+  * @brief get all track nodes of a Geant4 track (empty if it is not indexed)
+  */
+  const track_list & tracks(unsigned g4id) const;
+
+  /**
+  * @brief get the node owning the index
+  */
+  node * root() const { return root_; }
+
+  /**
+  * @brief get the number of indexed nodes
+  */
+  size_t size() const { return ids_.size(); }
+
+  /**
+  * @brief get the number of indexed Geant4 tracks
+  */
+  size_t track_count() const { return tracks_.size(); }
+
+private:
+
+  /**
+  * @brief add one node
+  */
+  void add(node * nd);
+
+  /**
+  * @brief destroy and deallocate an index (NULL is ignored)
+  */
+  static void release(node_index * idx);
+
+  // node owning the index
+  node * root_;
+
+  // node id to node
+  std::pmr::unordered_map<node_id,node *> ids_;
+
+  // Geant4 track id to its track nodes
+  std::pmr::unordered_map<unsigned,track_list> tracks_;
+
+};
+
+}
+
+#endif
@@ -0,0 +1,678 @@
+#ifndef MAPPED_H
+#define MAPPED_H
+
+/**
+* @file mapped.h
+* @author C S Cowden
+* @brief Read-only, memory-mapped access to binary graph files.
+* @details The classes in this file walk the binary format (see binio.h)
+* directly from the mapped file.  No node objects are allocated; a
+* `node_view` is a pointer to a node record.
+*/
+
+// --- includes ---
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+
+#include "relvec.h"
+#include "nodetypes.h"
+#include "binio.h"
+#include "names.h"
+#include "trajectory.h"
+#include "CaloGraphyIO.h"
+
+namespace cg {
+
+class node;
+class node_view;
+class child_range;
+class subgraph_range;
+
+/**
+* @brief predicate selecting views by their depth below the start of a walk
+*/
+typedef std::function<bool(const node_view &, unsigned)> view_predicate;
+
+/**
+* @brief Layout of the node records of a file
+*/
+struct record_layout {
+
+  /**
+  * @brief construct for a format version
+  */
+  explicit record_layout(uint32_t vers=bin::version)
+    :version(vers)
+    ,idsize(bin::id_size(vers))
+    ,tailsize(bin::tail_size(vers))
+    ,vecsize(32U)
+  { }
+
+  /**
+  * @brief set the coding of the 4-vectors
+  */
+  void set_coding(const bin::vector_coding & c) {
+    coding = c;
+    vecsize = c.size();
+  }
+
+  /**
+  * @brief layout of the current format version (without names)
+  */
+  static const record_layout * current();
+
+  // format version, size of the node id field and of the record tail
+  uint32_t version;
+  unsigned idsize;
+  unsigned tailsize;
+
+  // coding and size of the 4-vectors
+  bin::vector_coding coding;
+  unsigned vecsize;
+
+  // the names of the file (version 3), and their ids in process_names()
+  std::vector<std::string_view> names;
+  name_map ids;
+};
+
+/**
+* @brief Lightweight handle to a node record in a mapped file.
+* @details Accessors decode fields on demand.  Accessors specific to a
+* node type (pdg, name, ...) return default values for other types.
+* A view is only valid as long as the mapped_collection it came from.
+* Files with delta coded positions (see bin::vector_coding) need the
+* position of the parent, which views reached from the root carry along.
+*/
+class node_view {
+public:
+
+  /**
+  * @brief default constructor (invalid view)
+  */
+  node_view():rec_(NULL),end_(NULL),layout_(record_layout::current()),origin_(0.,0.,0.,0.) { }
+
+  /**
+  * @brief construct from a record
+  * @param[in] rec pointer to the first byte of the node record
+  * @param[in] end end of the event payload containing the record
+  * @param[in] layout layout of the records
+  * @param[in] origin position of the parent node (delta coded files)
+  */
+  node_view(const char * rec, const char * end, const record_layout * layout=record_layout::current(),
+      const relvec & origin=relvec(0.,0.,0.,0.))
+    :rec_(rec)
+    ,end_(end)
+    ,layout_(layout)
+    ,origin_(origin)
+  { }
+
+  /**
+  * @brief check if the view points to a record
+  */
+  bool valid() const { return rec_ != NULL; }
+
+  /**
+  * @brief Get the id of this node.
+  */
+  node_id id() const { return layout_->idsize == 4U ? field<uint32_t>(0) : field<uint64_t>(0); }
+
+  /**
+  * @brief Get the type of this node.
+  */
+  node_type type() const { return static_cast<node_type>(*(const uint8_t *)rec_); }
+
+  /**
+  * @brief Get the energy.
+  */
+  float energy() const { return field<float>(layout_->idsize); }
+
+  /**
+  * @brief Get the position of this node.
+  */
+  relvec pos() const { return position(layout_->idsize+4,origin_); }
+
+  /**
+  * @brief Get the PDG particle id code (tracks only).
+  */
+  int pdg() const { return is_track() ? field<int32_t>(layout_->idsize+4+layout_->vecsize) : 0; }
+
+  /**
+  * @brief Get the G4 track id (tracks only).
+  */
+  unsigned G4TrackID() const { return is_track() ? field<uint32_t>(layout_->idsize+8+layout_->vecsize) : 0U; }
+
+  /**
+  * @brief Get the 4-momentum (tracks only).
+  */
+  relvec momentum() const {
+    if ( !is_track() )
+      return relvec(0.,0.,0.,0.);
+    const unsigned offset = layout_->idsize+12+layout_->vecsize;
+    if ( !layout_->coding.relative() )
+      return vec(offset);
+    float v[4];
+    std::memcpy(v,fields()+offset,sizeof(v));
+    return relvec(v[0],v[1],v[2],v[3]);
+  }
+
+  /**
+  * @brief Get the number of step points (trajectories only).
+  */
+  unsigned nsteps() const { return type() == trajectoryNode ? field<uint32_t>(layout_->idsize+12+2*layout_->vecsize) : 0U; }
+
+  /**
+  * @brief Get a step point (trajectories only, i < nsteps()).
+  * @details The process id refers to process_names().
+  */
+  step_point step(unsigned i) const {
+    const unsigned vs = layout_->vecsize;
+    const unsigned offset = layout_->idsize+16+2*vs+(vs+6)*i;
+    const uint16_t proc = field<uint16_t>(offset+vs+4);
+    const relvec here = layout_->coding.relative() ? pos() : origin_;
+    return step_point{position(offset,here),field<float>(offset+vs),proc < layout_->ids.size() ? layout_->ids[proc] : name_id(0U)};
+  }
+
+  /**
+  * @brief Get the process name (processes only).
+  */
+  std::string_view name() const {
+    if ( type() != processNode )
+      return std::string_view();
+    if ( layout_->version < 3U )
+      return std::string_view(fields()+layout_->idsize+38,field<uint16_t>(layout_->idsize+36));
+    const uint16_t id = field<uint16_t>(layout_->idsize+4+layout_->vecsize);
+    return id < layout_->names.size() ? layout_->names[id] : std::string_view();
+  }
+
+  /**
+  * @brief Get the number of children.
+  */
+  unsigned nchildren() const { return load<uint32_t>(fields()+field_length()); }
+
+  /**
+  * @brief Get the first byte after the record, where the children start.
+  */
+  const char * children_begin() const { return fields()+field_length()+layout_->tailsize; }
+
+  /**
+  * @brief Get the children of this node.
+  * @details Moving from one child to the next skips the records of the
+  * sub-graph below the first, so visiting all children costs a walk over
+  * the sub-graph.  Use subgraph() to scan whole showers.
+  */
+  inline child_range children() const;
+
+  /**
+  * @brief Get the nodes of the sub-graph below (and including) this node
+  * in depth-first (pre-)order.
+  * @details This is a linear scan over the records.
+  */
+  inline subgraph_range subgraph() const;
+
+  /**
+  * @brief Get the number of bytes used by the sub-graph below this node.
+  * @details Since version 5 the length is stored in the record, older
+  * files are walked.  The size never reaches past the end of the event,
+  * whatever the lengths stored in a damaged file.
+  */
+  size_t subgraph_size() const;
+
+  /**
+  * @brief Build the node objects for the sub-graph below this node.
+  * @return The caller takes ownership of the returned node.
+  */
+  node * extract() const;
+
+  /**
+  * @brief Build the node object of this node alone (no children).
+  */
+  node * extract_node() const;
+
+  /**
+  * @brief Build the node objects down to a depth below this node.
+  * @details The records of deeper nodes are skipped, not decoded.
+  * @param[in] maxDepth depth of the deepest nodes built (this node is at 0)
+  */
+  node * extract(unsigned maxDepth) const;
+
+  /**
+  * @brief Build the node objects of the nodes selected by a predicate.
+  * @details keep(view,depth) is called for the nodes below this one; the
+  * sub-graphs of the nodes it rejects are skipped.
+  */
+  node * extract_if(const view_predicate & keep) const;
+
+  /**
+  * @brief Build the node objects for the sub-graph below this node,
+  * decoding sibling sub-graphs concurrently.
+  * @details The nodes of sub-graphs larger than a share of the whole are
+  * built by the calling thread, the smaller sub-graphs below them by a set
+  * of threads.  The result is the same as extract().
+  * @param[in] nthreads number of threads (0 for the hardware concurrency)
+  */
+  node * extract_parallel(unsigned nthreads=0U) const;
+
+  /**
+  * @brief get the first byte of the record
+  */
+  const char * record() const { return rec_; }
+
+  /**
+  * @brief get the position of the parent (delta coded files)
+  */
+  const relvec & origin() const { return origin_; }
+
+  /**
+  * @brief comparison
+  */
+  bool operator==(const node_view & nv) const { return rec_ == nv.rec_; }
+  bool operator!=(const node_view & nv) const { return rec_ != nv.rec_; }
+
+private:
+
+  template<typename T>
+  static T load(const char * p) {
+    T val;
+    std::memcpy(&val,p,sizeof(T));
+    return val;
+  }
+
+  const char * fields() const { return rec_+5; }
+
+  bool is_track() const { return type() == trackNode || type() == trajectoryNode; }
+
+  uint32_t field_length() const { return load<uint32_t>(rec_+1); }
+
+  template<typename T>
+  T field(unsigned offset) const { return load<T>(fields()+offset); }
+
+  relvec vec(unsigned offset) const {
+    double v[4];
+    std::memcpy(v,fields()+offset,sizeof(v));
+    return relvec(v[0],v[1],v[2],v[3]);
+  }
+
+  relvec position(unsigned offset, const relvec & ref) const {
+    if ( !layout_->coding.relative() )
+      return vec(offset);
+    return layout_->coding.decode(fields()+offset,ref);
+  }
+
+  // the record and the end of the event payload
+  const char * rec_;
+  const char * end_;
+
+  // layout of the records
+  const record_layout * layout_;
+
+  // position of the parent
+  relvec origin_;
+
+  friend class child_range;
+  friend class subgraph_range;
+};
+
+
+/**
+* @brief Range over the children of a node_view.
+* @details Advancing the iterator skips the sub-graph of the current child.
+*/
+class child_range {
+public:
+
+  /**
+  * @brief forward iterator over child views
+  */
+  class iterator {
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef node_view value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const node_view * pointer;
+    typedef const node_view & reference;
+
+    iterator():left_(0U) { }
+    iterator(const node_view & nv, unsigned left):cur_(nv),left_(left) { }
+
+    reference operator*() const { return cur_; }
+    pointer operator->() const { return &cur_; }
+
+    iterator & operator++() {
+      if ( --left_ )
+        cur_ = node_view(cur_.rec_+cur_.subgraph_size(),cur_.end_,cur_.layout_,cur_.origin_);
+      else
+        cur_ = node_view();
+      return *this;
+    }
+
+    iterator operator++(int) { iterator it(*this); ++(*this); return it; }
+
+    bool operator==(const iterator & it) const { return left_ == it.left_; }
+    bool operator!=(const iterator & it) const { return left_ != it.left_; }
+
+  private:
+    node_view cur_;
+    unsigned left_;
+  };
+
+  /**
+  * @brief construct from a parent view
+  */
+  explicit child_range(const node_view & parent)
+    :first_(parent.children_begin(),parent.end_,parent.layout_,
+        parent.layout_->coding.relative() ? parent.pos() : parent.origin_)
+    ,n_(parent.nchildren())
+  { }
+
+  iterator begin() const { return n_ ? iterator(first_,n_) : iterator(); }
+  iterator end() const { return iterator(); }
+
+  /**
+  * @brief get the number of children
+  */
+  unsigned size() const { return n_; }
+
+  /**
+  * @brief check for no children
+  */
+  bool empty() const { return n_ == 0U; }
+
+private:
+  node_view first_;
+  unsigned n_;
+};
+
+// get the children
+child_range node_view::children() const { return child_range(*this); }
+
+
+/**
+* @brief Depth-first range over the records of a sub-graph.
+*/
+class subgraph_range {
+public:
+
+  /**
+  * @brief forward iterator over the views of the sub-graph
+  */
+  class iterator {
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef node_view value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const node_view * pointer;
+    typedef const node_view & reference;
+
+    iterator() { }
+    explicit iterator(const node_view & nv):cur_(nv),pending_(1,level{1U,nv.origin_}) { }
+
+    reference operator*() const { return cur_; }
+    pointer operator->() const { return &cur_; }
+
+    /**
+    * @brief depth of the current node relative to the start of the range
+    */
+    unsigned depth() const { return pending_.size()-1; }
+
+    iterator & operator++() {
+      // this node has been visited, queue its children
+      pending_.back().left--;
+      const unsigned nkids = cur_.nchildren();
+      const char * next = cur_.children_begin();
+      if ( nkids )
+        pending_.push_back(level{nkids,cur_.layout_->coding.relative() ? cur_.pos() : cur_.origin_});
+
+      // pop the levels which are complete
+      while ( !pending_.empty() && pending_.back().left == 0U )
+        pending_.pop_back();
+
+      if ( pending_.empty() || next >= cur_.end_ )
+        cur_ = node_view();
+      else
+        cur_ = node_view(next,cur_.end_,cur_.layout_,pending_.back().origin);
+      return *this;
+    }
+
+    iterator operator++(int) { iterator it(*this); ++(*this); return it; }
+
+    bool operator==(const iterator & it) const { return cur_ == it.cur_; }
+    bool operator!=(const iterator & it) const { return cur_ != it.cur_; }
+
+  private:
+    // nodes still to be visited at a level and the position of their parent
+    struct level {
+      unsigned left;
+      relvec origin;
+    };
+
+    node_view cur_;
+    std::vector<level> pending_;
+  };
+
+  /**
+  * @brief construct from the top of the sub-graph
+  */
+  explicit subgraph_range(const node_view & top):top_(top) { }
+
+  iterator begin() const { return top_.valid() ? iterator(top_) : iterator(); }
+  iterator end() const { return iterator(); }
+
+private:
+  node_view top_;
+};
+
+// get the sub-graph
+subgraph_range node_view::subgraph() const { return subgraph_range(*this); }
+
+
+/**
+* @brief Graph of node objects expanded from a node_view on demand.
+* @details The nodes are built down to a depth; the children of the nodes
+* at the boundary are built when they are expanded.  Useful to browse the
+* first generations of a large shower without decoding the rest.  The graph
+* is owned by the lazy_graph (see release()) and is only expandable while
+* the mapped_collection of the view is open.
+*/
+class lazy_graph {
+public:
+
+  /**
+  * @brief construct, building the nodes down to a depth below the root
+  */
+  explicit lazy_graph(const node_view & root, unsigned depth=1U);
+
+  /**
+  * @brief destructor (deletes the graph unless released)
+  */
+  ~lazy_graph();
+
+  // the graph is not copyable
+  lazy_graph(const lazy_graph &) = delete;
+  lazy_graph & operator=(const lazy_graph &) = delete;
+
+  /**
+  * @brief get the root node
+  */
+  node * root() const { return root_; }
+
+  /**
+  * @brief check if the children of a node are built
+  */
+  bool expanded(const node * nd) const { return pending_.find(nd) == pending_.end(); }
+
+  /**
+  * @brief build the children of a node down to a depth below it
+  * @details Nothing is done for nodes which are already expanded.
+  */
+  void expand(node * nd, unsigned depth=1U);
+
+  /**
+  * @brief give up the ownership of the graph (it can not be expanded any more)
+  */
+  node * release();
+
+private:
+
+  // the graph
+  node * root_;
+
+  // views of the nodes whose children are not built
+  std::unordered_map<const node *,node_view> pending_;
+
+};
+
+
+/**
+* @brief Read-only, memory-mapped collection of event graphs.
+* @details The file is mapped into memory and only the event index (or the
+* chunk headers of files without one) is read when it is opened, so opening is fast and files larger than memory
+* can be scanned; pages are loaded by the OS as graphs are walked.
+* Compressed events are decompressed the first time they are accessed and
+* kept until the file is closed; different events may be accessed (and
+* decompressed) by several threads at the same time.
+*/
+class mapped_collection {
+public:
+
+  /**
+  * @brief default constructor
+  */
+  mapped_collection():data_(NULL),size_(0U),layout_(0U) { }
+
+  /**
+  * @brief construct and open a file
+  */
+  explicit mapped_collection(const std::string & name)
+    :data_(NULL),size_(0U),layout_(0U)
+  { open(name); }
+
+  /**
+  * @brief destructor (unmaps the file)
+  */
+  ~mapped_collection() { close(); }
+
+  // the mapping is not copyable
+  mapped_collection(const mapped_collection &) = delete;
+  mapped_collection & operator=(const mapped_collection &) = delete;
+
+  /**
+  * @brief map a binary graph file
+  * @return false if the file can not be mapped or is not a binary graph file.
+  */
+  bool open(const std::string & name);
+
+  /**
+  * @brief unmap the file
+  */
+  void close();
+
+  /**
+  * @brief check if a file is mapped
+  */
+  bool is_open() const { return data_ != NULL; }
+
+  /**
+  * @brief get the number of events/graphs
+  */
+  size_t size() const { return events_.size(); }
+
+  /**
+  * @brief get the root of the graph of an event
+  */
+  node_view operator[](size_t i) const {
+    if ( compressed(i) )
+      return inflate(i);
+    return node_view(data_+events_[i].first,data_+events_[i].first+events_[i].second,&layout_);
+  }
+
+  /**
+  * @brief check if an event is stored compressed
+  */
+  bool compressed(size_t i) const {
+    uint32_t tag;
+    std::memcpy(&tag,data_+events_[i].first-bin::chunk_header_size,sizeof(tag));
+    return tag == bin::compressedEventTag;
+  }
+
+  /**
+  * @brief get the format version of the file
+  */
+  uint32_t version() const { return layout_.version; }
+
+  /**
+  * @brief Build the node objects of all events, decoding events concurrently.
+  * @details Events are handed out one at a time to the threads, and the
+  * graphs are returned in file order, like ReadCollection().  As with the
+  * serial reader, the collection ends before the first event which can not
+  * be decoded.  Compressed events are not kept decompressed.
+  * @param[in] nthreads number of threads (0 for the hardware concurrency)
+  * @return The caller takes ownership of the graphs.
+  */
+  node_collection extract(unsigned nthreads=0U) const;
+
+private:
+
+  /**
+  * @brief read the event index from the end of the file
+  */
+  bool read_index();
+
+  /**
+  * @brief read a name chunk
+  */
+  bool read_names(uint64_t offset, uint64_t len);
+
+  /**
+  * @brief set up the decompressed events once the events are located
+  */
+  void prepare();
+
+  /**
+  * @brief decompress an event (once) and view it
+  */
+  node_view inflate(size_t i) const;
+
+  template<typename T>
+  static T load(const char * p) {
+    T val;
+    std::memcpy(&val,p,sizeof(T));
+    return val;
+  }
+
+  // the mapping
+  const char * data_;
+  size_t size_;
+
+  // layout of the records (format version and names)
+  record_layout layout_;
+
+  // offset and length of each event payload
+  bin::event_index events_;
+
+  // decompressed events
+  mutable std::unique_ptr<std::once_flag[]> once_;
+  mutable std::vector<std::vector<char> > inflated_;
+
+};
+
+/**
+* @brief Read a collection, decoding the events of binary files in parallel.
+* @details The file is mapped and split at the event boundaries (the event
+* index, or the chunk headers of files without one).  Text files are read
+* serially.  The graphs are in the same order as ReadCollection().
+* @param[in] name The file name.
+* @param[in] nthreads number of threads (0 for the hardware concurrency)
+*/
+node_collection ReadCollectionParallel(const std::string & name, unsigned nthreads=0U);
+
+}
+
+#endif
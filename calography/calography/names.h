@@ -0,0 +1,102 @@
+#ifndef NAMES_H
+#define NAMES_H
+
+/**
+* @file names.h
+* @author C S Cowden
+* @brief Declare the table of interned (process) names.
+*/
+
+// --- includes ---
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cg {
+
+/**
+* @brief id of an interned name
+*/
+typedef uint16_t name_id;
+
+/**
+* @brief map from the name ids of a file to the ids of the name table
+*/
+typedef std::vector<name_id> name_map;
+
+/**
+* @brief Table of interned names
+* @details Each distinct name is stored once and identified by a small
+* integer id, which stays valid for the lifetime of the table.  Id 0 is the
+* empty name.  Interning takes a lock; looking up the name of an id does
+* not, so nodes can be printed or written from any thread.
+*/
+class name_table {
+public:
+
+  /**
+  * @brief constructor (holds the empty name)
+  */
+  name_table();
+
+  /**
+  * @brief destructor
+  */
+  ~name_table();
+
+  // the table is not copyable
+  name_table(const name_table &) = delete;
+  name_table & operator=(const name_table &) = delete;
+
+  /**
+  * @brief get the id of a name, adding the name if it is new
+  */
+  name_id intern(std::string_view name);
+
+  /**
+  * @brief look up the id of a name
+  * @return the id, or -1 if the name is not in the table
+  */
+  int32_t lookup(std::string_view name) const;
+
+  /**
+  * @brief get the name of an id (empty for unknown ids)
+  */
+  std::string_view name(name_id id) const;
+
+  /**
+  * @brief get the number of names
+  */
+  size_t size() const { return size_.load(std::memory_order_acquire); }
+
+  /// number of names per block of storage
+  static const unsigned blockSize = 256U;
+
+  /// maximum number of blocks
+  static const unsigned maxBlocks = 256U;
+
+private:
+
+  // blocks of names, never moved once allocated
+  std::atomic<std::string *> blocks_[maxBlocks];
+  std::atomic<size_t> size_;
+
+  // name to id (guarded by mutex_)
+  std::map<std::string,name_id,std::less<> > ids_;
+  mutable std::mutex mutex_;
+
+};
+
+/**
+* @brief get the table of process names
+*/
+name_table & process_names();
+
+}
+
+#endif
@@ -11,12 +11,36 @@
 #include <ostream>
 #include <istream>
 #include <vector>
+#include <memory_resource>
+#include <atomic>
 
 #include "relvec.h"
 #include "nodetypes.h"
+#include "binio.h"
+#include "arena.h"
+#include "index.h"
 
 namespace cg {
 
+class node;
+class track;
+
+/**
+* @brief list of child nodes (allocated from the same arena as the node)
+*/
+typedef std::pmr::vector<node *> node_list;
+
+/**
+* @brief Aggregates of the sub-graph below (and including) a node
+*/
+struct aggregate {
+  double energy;      // total deposited energy
+  uint64_t nodes;     // number of nodes
+  float lo[4];        // smallest t, x, y, z of the positions and step points
+  float hi[4];        // largest t, x, y, z of the positions and step points
+  bool valid;         // false once the sub-graph has changed
+};
+
 
 /**
 * @brief Abstract node class
@@ -25,6 +49,15 @@ namespace cg {
 *  * There is a generic concept of energy stored in the node class.  Its
 *  proper interpretation depends on the specific type of the node.
 *  * Subtypes can be distinguished by the node type enum.
+*  * Nodes created while an arena is current on the thread (see arena.h)
+*    are allocated from the arena, including their child lists.
+*  * Each node links to its parent (set by add_child() and the readers).
+*  * Sub-graph aggregates (see aggregates()) are cached in the nodes and
+*    computed on demand.  Changes made through the setters and add_child()
+*    mark the caches of the node and its ancestors as stale; the mark stops
+*    at the first stale ancestor, so growing a graph costs O(1) per change.
+*  * An optional index (see build_index() and index.h) makes find() and
+*    find_track() constant time; add_child() keeps it up to date.
 */
 class node {
 public:
@@ -32,14 +65,18 @@ public:
   /**
   * @brief default constructor
   */
-  node():id_(nNodes_++),type_(genericNode) { }
+  node():id_(next_id()),type_(genericNode),children_(arena::resource()),parent_(NULL),agg_(NULL),index_(NULL) { }
 
   /**
   * @brief construct with a given node type.
   */
   node(node_type nt)
-    :id_(nNodes_++)
+    :id_(next_id())
     ,type_(nt)
+    ,children_(arena::resource())
+    ,parent_(NULL)
+    ,agg_(NULL)
+    ,index_(NULL)
   { }
 
   /**
@@ -48,21 +85,28 @@ public:
   * @param[in] pos the position of the node.
   */
   node(node_type nt, double E, const relvec& rc)
-    :id_(nNodes_++)
+    :id_(next_id())
     ,type_(nt)
     ,energy_(E)
     ,pos_(rc)
+    ,children_(arena::resource())
+    ,parent_(NULL)
+    ,agg_(NULL)
+    ,index_(NULL)
   { }
 
   /**
-  * @brief copy constructor
+  * @brief copy constructor (the copy has no parent and no index)
   */
   node(const node& nd)
     :id_(nd.id_)
     ,type_(nd.type_)
     ,energy_(nd.energy_)
     ,pos_(nd.pos_) 
-    ,children_(nd.children_)
+    ,children_(nd.children_,arena::resource())
+    ,parent_(NULL)
+    ,agg_(NULL)
+    ,index_(NULL)
   { }
 
   /**
@@ -70,15 +114,33 @@ public:
   */
   virtual ~node();
 
+  /**
+  * @brief allocate from the current arena, or the heap if there is none.
+  */
+  static void * operator new(std::size_t sz);
+
+  /**
+  * @brief free heap allocated nodes (arena memory is left to the arena).
+  */
+  static void operator delete(void * p);
+
   /**
   * @brief Add child node.
   * @param[in] nd point to a node.  This class takes ownership of the pointer.
   */
   virtual void add_child(node * nd) {
     children_.push_back(nd);
+    nd->parent_ = this;
+    invalidate();
+    if ( index_ )
+      index_->insert(nd);
   }
 
   // --- serialization methods ---
+  // The sub-graph methods below walk the graph without recursion and use
+  // the per node field methods for each node.  Nodes are handled as the
+  // class belonging to their node type.
+
   /**
   * @brief serialize
   * @param[in] stream The output stream into which to write this node.
@@ -91,6 +153,38 @@ public:
   */
   virtual void deserialize(std::istream & stream);
 
+  /**
+  * @brief write the sub-graph below this node in the binary format.
+  * @param[in] buf The buffer into which to write this node.
+  */
+  void write(bin::obuffer & buf) const;
+
+  /**
+  * @brief read the sub-graph below this node from the binary format.
+  * @param[in] buf The buffer from which to read this node.
+  */
+  void read(bin::ibuffer & buf);
+
+  /**
+  * @brief serialize the fields of this node only (text format, no children).
+  */
+  virtual void serialize_fields(std::ostream & stream) const;
+
+  /**
+  * @brief deserialize the fields of this node only (text format, no children).
+  */
+  virtual void deserialize_fields(std::istream & stream);
+
+  /**
+  * @brief write the fields of this node only (binary format, no type or children).
+  */
+  virtual void write_fields(bin::obuffer & buf) const;
+
+  /**
+  * @brief read the fields of this node only (binary format, no type or children).
+  */
+  virtual void read_fields(bin::ibuffer & buf);
+
   /**
   * @brief insertion operator
   * This method can be used to insert the sub-graph below this node into a stream.
@@ -119,11 +213,17 @@ public:
   */
   virtual void print(int lvl=0 ) const;
 
+  /**
+  * @brief print the details of this node only.
+  * @param[in] lvl The indentation level.
+  */
+  virtual void print_node(int lvl=0) const;
+
 
   /**
   * @brief Get the id of this node.
   */
-  virtual unsigned id() const { return id_; }
+  virtual node_id id() const { return id_; }
 
   /**
   * @brief Get the type of this node.
@@ -143,7 +243,12 @@ public:
   /**
   * @brief Get the children of this node.
   */
-  const std::vector<node*> & children() const { return children_; }
+  const node_list & children() const { return children_; }
+
+  /**
+  * @brief Get the parent of this node (NULL for the root).
+  */
+  node * parent() const { return parent_; }
 
 
   // --- analysis methods ---
@@ -160,9 +265,28 @@ public:
   /**
   * @brief Sum the deposited energy in this sub-graph.
   * @return The sum of the (readable) energy from the sub-graph.
+  * @details O(1) once the aggregates are cached.
   */
   virtual double totalenergy() const;
 
+  /**
+  * @brief Get the aggregates of this sub-graph.
+  * @details Stale aggregates are recomputed in one post-order pass which
+  * reuses the caches of the sub-graphs which have not changed.  Not safe
+  * to call from several threads on the same graph.
+  */
+  const aggregate & aggregates() const;
+
+  /**
+  * @brief Mark the aggregates of this node and its ancestors as stale.
+  * @details Called by the setters; derived classes call it when they
+  * change what the aggregates depend on.
+  */
+  void invalidate() {
+    for ( node * nd = this; nd && nd->agg_ && nd->agg_->valid; nd = nd->parent_ )
+      nd->agg_->valid = false;
+  }
+
   /**
   * @brief Get steps (tracks) that deposit energy for further analysis
   * in the sub-graph.
@@ -175,8 +299,38 @@ public:
   * @brief look up a specific node.
   * @param[in] id The node id.
   * @return A pointer to the node (NULL if the node is not found).
+  * @details Constant time if this node owns an index, a walk up from the
+  * indexed node if it belongs to the index of an ancestor, otherwise a
+  * depth-first search of the sub-graph.  If ids repeat, an index finds the
+  * node indexed first (see index.h); when that node is not below this one
+  * the sub-graph is searched.
   */
-  virtual node * find(const unsigned id);
+  virtual node * find(const node_id id);
+
+  /**
+  * @brief look up the first track node of a Geant4 track.
+  * @param[in] g4id The Geant4 track id.
+  * @return A pointer to the track (NULL if the track is not found).
+  * @details Uses the index like find().
+  */
+  track * find_track(unsigned g4id);
+
+  /**
+  * @brief index the sub-graph below this node (see index.h)
+  * @details Rebuilds an index owned by this node.  Nothing is done if the
+  * node already belongs to the index of an ancestor.
+  */
+  void build_index();
+
+  /**
+  * @brief remove the index owned by this node
+  */
+  void drop_index();
+
+  /**
+  * @brief get the index this node belongs to (NULL if none)
+  */
+  const node_index * index() const { return index_; }
 
 
   // --- setter methods ---
@@ -201,7 +355,7 @@ protected:
   virtual void deserialize_children(std::istream &);
 
   // node id
-  unsigned id_;
+  node_id id_;
 
   // node type
   node_type type_;
@@ -213,20 +367,34 @@ protected:
   relvec pos_;
 
   // children of this node
-  std::vector<node *> children_;
+  node_list children_;
+
+  // parent of this node
+  node * parent_;
 
 private:
 
+  // cached aggregates (allocated like the child list), NULL until computed
+  mutable aggregate * agg_;
+
+  // index this node belongs to (owned by the root of the index), or NULL
+  node_index * index_;
+
+  friend class node_index;
+
   /**
-  * @brief append nodes to shower list..
+  * @brief allocate a unique node id
+  * @details Each thread takes blocks of idBlock ids from the shared
+  * counter and hands them out without synchronization, so ids are unique
+  * but not consecutive across threads.
   */
-  virtual void shower(std::vector<const node *> &) const;
+  static node_id next_id();
+
+  /// number of ids taken from the shared counter at a time
+  static const node_id idBlock = 4096U;
 
-  /// 
-  /// node count, use this to increment each time
-  /// a new node is created.  This will ensure
-  /// each node has a unique id.
-  static unsigned nNodes_;
+  /// start of the next free block of ids
+  static std::atomic<node_id> nextBlock_;
 
 }; 
 
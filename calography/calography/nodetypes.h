@@ -5,18 +5,27 @@
 * @author C S Cowden
 * @file nodetypes.h
 * @brief define node types
-* @details define three node types
+* @details define the node id type and four node types
 *  * generic
 *  * process
 *  * track
+*  * trajectory (a track with its step points)
 */
 
+#include <cstdint>
+
 namespace cg {
 
+/**
+* @brief node identifier
+*/
+typedef uint64_t node_id;
+
 enum node_type {
   genericNode,
   processNode,
-  trackNode
+  trackNode,
+  trajectoryNode
 };
 
 }
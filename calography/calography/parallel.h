@@ -0,0 +1,298 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+/**
+* @file parallel.h
+* @author C S Cowden
+* @brief Declare a work-stealing thread pool and parallel loops and
+* reductions over the events of a collection.
+*/
+
+// --- includes ---
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "CaloGraphyIO.h"
+#include "event_list.h"
+
+namespace cg {
+
+class collection_reader;
+
+/**
+* @brief Work-stealing thread pool
+* @details A job covers the indices [0,n) of a loop.  A worker splits the
+* range it holds in halves, keeping the lower half and queueing the upper
+* half, until a range is no larger than the grain; it runs the lowest
+* range and then takes the last range it queued.  Idle workers steal the
+* first (largest) range queued by another worker, so the load is balanced
+* however the cost of the indices varies.  The default grain gives each
+* worker about 64 ranges, to bound the cost of queueing for small events.
+*
+* The thread which starts a job does not take part in it.  A job started
+* by a worker of the same pool is run on that worker, serially.  The body
+* of a job must not throw.
+*/
+class thread_pool {
+public:
+
+  /**
+  * @brief body of a job, called for the indices [begin,end) on a worker
+  */
+  typedef std::function<void(size_t begin, size_t end, unsigned worker)> range_body;
+
+  /**
+  * @brief A job of the pool (a loop over [0,n))
+  */
+  class job {
+  public:
+
+    /**
+    * @brief constructor
+    * @param[in] n the number of indices
+    * @param[in] body the loop body
+    * @param[in] grain the largest range which is not split (0 for the default)
+    */
+    job(size_t n, const range_body & body, size_t grain=0U)
+      :n_(n),grain_(grain),body_(body),remaining_(n),done_(n == 0U)
+    { }
+
+    // a job is not copyable
+    job(const job &) = delete;
+    job & operator=(const job &) = delete;
+
+  private:
+    friend class thread_pool;
+
+    size_t n_;
+    size_t grain_;
+    range_body body_;
+
+    // indices not yet run, and the notification of the end of the job
+    std::atomic<size_t> remaining_;
+    std::mutex lock_;
+    std::condition_variable finished_;
+    bool done_;
+  };
+
+  /**
+  * @brief constructor, start the workers
+  * @param[in] nthreads number of workers (0 for the hardware concurrency)
+  */
+  explicit thread_pool(unsigned nthreads=0U);
+
+  /**
+  * @brief destructor, stop the workers (jobs must have finished)
+  */
+  ~thread_pool();
+
+  // the pool is not copyable
+  thread_pool(const thread_pool &) = delete;
+  thread_pool & operator=(const thread_pool &) = delete;
+
+  /**
+  * @brief get the number of workers
+  */
+  unsigned size() const { return unsigned(threads_.size()); }
+
+  /**
+  * @brief get the index of the calling thread in this pool
+  * @return the worker index or -1 if the thread is not a worker of this pool
+  */
+  int worker() const;
+
+  /**
+  * @brief start a job (it must be waited for before it is destroyed)
+  */
+  void start(job & jb);
+
+  /**
+  * @brief wait for a job to finish
+  */
+  void wait(job & jb);
+
+  /**
+  * @brief run a loop over [0,n) and wait for it
+  */
+  void run(size_t n, const range_body & body, size_t grain=0U) {
+    job jb(n,body,grain);
+    start(jb);
+    wait(jb);
+  }
+
+private:
+
+  /**
+  * @brief a range of a job
+  */
+  struct range {
+    job * jb;
+    size_t begin, end;
+  };
+
+  /**
+  * @brief the ranges queued by a worker
+  */
+  struct queue {
+    std::mutex lock;
+    std::deque<range> ranges;
+  };
+
+  /**
+  * @brief main loop of a worker
+  */
+  void work(unsigned w);
+
+  /**
+  * @brief take a range, from the worker's queue or stolen from another
+  */
+  bool take(unsigned w, range & r);
+
+  /**
+  * @brief queue a range on a worker
+  */
+  void push(unsigned w, const range & r);
+
+  /**
+  * @brief split and run a range
+  */
+  void execute(unsigned w, range r);
+
+  /**
+  * @brief count indices of a job as run, notify the end of the job
+  */
+  static void finish(job & jb, size_t n);
+
+  // workers and their queues
+  std::vector<std::thread> threads_;
+  std::vector<std::unique_ptr<queue> > queues_;
+
+  // number of queued ranges, sleeping workers and their wake up
+  std::atomic<size_t> queued_;
+  std::atomic<unsigned> sleeping_;
+  std::mutex sleep_;
+  std::condition_variable wake_;
+  bool stop_;
+
+  // next worker to be given a job
+  std::atomic<unsigned> next_;
+
+};
+
+/**
+* @brief get the shared pool (one worker per hardware thread, started on
+* first use)
+*/
+thread_pool & default_pool();
+
+
+/**
+* @brief Run a function on each event of a collection, in parallel
+* @details fn(nd,i) is called once for each graph nd at index i of the
+* collection; calls for different events may run concurrently, in any
+* order.
+*/
+template <class F>
+void parallel_for_each_event(const node_collection & nc, F && fn, thread_pool & pool=default_pool()) {
+  pool.run(nc.size(),[&nc,&fn](size_t begin, size_t end, unsigned) {
+    for ( size_t i=begin; i != end; i++ )
+      fn(nc[i],i);
+  });
+}
+
+/**
+* @brief Run a function on each published event of an event list, in parallel
+* @details The events published when the call starts are visited.
+*/
+template <class F>
+void parallel_for_each_event(const event_list & el, F && fn, thread_pool & pool=default_pool()) {
+  pool.run(el.size(),[&el,&fn](size_t begin, size_t end, unsigned) {
+    for ( size_t i=begin; i != end; i++ )
+      fn(el[i],i);
+  });
+}
+
+/**
+* @brief Run a function on each remaining event of a streaming reader
+* @details The calling thread reads the events while the workers run
+* fn(nd,i,worker) on those read before, so only a few events per worker
+* are in memory.  The reader must not be pooled (the graphs are released
+* and deleted once visited); a pooled reader is visited serially on the
+* calling thread (worker 0).
+* @return the number of events visited
+*/
+size_t parallel_read(collection_reader & reader,
+    const std::function<void(node * nd, size_t i, unsigned worker)> & fn,
+    thread_pool & pool=default_pool());
+
+/**
+* @brief Run a function on each remaining event of a streaming reader, in
+* parallel (see parallel_read())
+* @return the number of events visited
+*/
+template <class F>
+size_t parallel_for_each_event(collection_reader & reader, F && fn, thread_pool & pool=default_pool()) {
+  return parallel_read(reader,[&fn](node * nd, size_t i, unsigned) { fn(nd,i); },pool);
+}
+
+
+/**
+* @brief accumulators of a reduction, one per worker (on separate cache lines)
+*/
+template <class T>
+struct alignas(64) reduce_slot {
+  T value;
+};
+
+/**
+* @brief Reduce the events of a collection in parallel
+* @details Each worker accumulates the events it runs into its own copy of
+* init with acc(value,nd); the copies are then combined in worker order
+* with merge(result,value), starting from the copy of worker 0.  init
+* must be an identity of merge (e.g. zero for a sum).
+* @code
+*   double e = cg::parallel_reduce(nc,0.,
+*     [](double & sum, cg::node * nd) { sum += nd->totalenergy(); },
+*     [](double & sum, const double & s) { sum += s; });
+* @endcode
+*/
+template <class T, class A, class M>
+T parallel_reduce(const node_collection & nc, const T & init, A && acc, M && merge,
+    thread_pool & pool=default_pool()) {
+  std::vector<reduce_slot<T> > slots(pool.size(),reduce_slot<T>{init});
+  pool.run(nc.size(),[&nc,&acc,&slots](size_t begin, size_t end, unsigned w) {
+    T & value = slots[w].value;
+    for ( size_t i=begin; i != end; i++ )
+      acc(value,nc[i]);
+  });
+  T result = slots[0].value;
+  for ( size_t w=1; w < slots.size(); w++ )
+    merge(result,static_cast<const T &>(slots[w].value));
+  return result;
+}
+
+/**
+* @brief Reduce the remaining events of a streaming reader in parallel
+* (see parallel_read() and the collection version)
+*/
+template <class T, class A, class M>
+T parallel_reduce(collection_reader & reader, const T & init, A && acc, M && merge,
+    thread_pool & pool=default_pool()) {
+  std::vector<reduce_slot<T> > slots(pool.size(),reduce_slot<T>{init});
+  parallel_read(reader,[&acc,&slots](node * nd, size_t, unsigned w) { acc(slots[w].value,nd); },pool);
+  T result = slots[0].value;
+  for ( size_t w=1; w < slots.size(); w++ )
+    merge(result,static_cast<const T &>(slots[w].value));
+  return result;
+}
+
+}
+
+#endif
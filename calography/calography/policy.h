@@ -0,0 +1,154 @@
+#ifndef POLICY_H
+#define POLICY_H
+
+/**
+* @file policy.h
+* @author C S Cowden
+* @brief Declare the policy deciding which steps and tracks are recorded.
+*/
+
+// --- includes ---
+#include <vector>
+#include <string_view>
+#include <cstdint>
+#include <limits>
+
+#include "names.h"
+
+namespace cg {
+
+/**
+* @brief Recording policy
+* @details Decides at step time which steps and new (secondary) tracks are
+* recorded in the graph.  The default policy records everything.
+*  * A step is recorded if its process is allowed, its time is inside the
+*    time window and it deposits at least the minimum deposit, or if it
+*    creates a recorded secondary.
+*  * A secondary is recorded if the step creating it has an allowed process
+*    and is inside the time window, its particle is allowed, its total
+*    energy is at least the minimum track energy and its generation (the
+*    primary is generation 0) is at most the maximum depth.
+* The energy deposited by steps and tracks which are not recorded is added
+* to the nearest recorded track node above them, so energy sums over the
+* graph are unchanged.
+*/
+class recording_policy {
+public:
+
+  /**
+  * @brief default constructor (records everything)
+  */
+  recording_policy();
+
+  // --- setters ---
+
+  /**
+  * @brief set the minimum energy deposited by a recorded step
+  */
+  void set_min_deposit(double E) { minDeposit_ = E; }
+
+  /**
+  * @brief set the minimum total energy of a recorded secondary
+  */
+  void set_min_track_energy(double E) { minTrackEnergy_ = E; }
+
+  /**
+  * @brief set the maximum generation of recorded secondaries
+  */
+  void set_max_depth(unsigned depth) { maxDepth_ = depth; }
+
+  /**
+  * @brief set the time window of recorded steps
+  */
+  void set_time_window(double tmin, double tmax) { tmin_ = tmin; tmax_ = tmax; }
+
+  /**
+  * @brief record only allowed processes (once any process is allowed)
+  */
+  void allow_process(std::string_view name);
+
+  /**
+  * @brief do not record a process
+  */
+  void deny_process(std::string_view name);
+
+  /**
+  * @brief record only allowed particles (once any particle is allowed)
+  */
+  void allow_particle(int pdg);
+
+  /**
+  * @brief do not record a particle
+  */
+  void deny_particle(int pdg);
+
+  /**
+  * @brief restore the default policy (record everything)
+  */
+  void clear();
+
+  // --- getters ---
+
+  double min_deposit() const { return minDeposit_; }
+  double min_track_energy() const { return minTrackEnergy_; }
+  unsigned max_depth() const { return maxDepth_; }
+  double tmin() const { return tmin_; }
+  double tmax() const { return tmax_; }
+
+  /**
+  * @brief check if the policy records everything
+  */
+  bool records_all() const;
+
+  // --- decisions ---
+
+  /**
+  * @brief check if a step may record its process and secondaries
+  * @param[in] proc the process limiting the step
+  * @param[in] t the time of the end of the step
+  */
+  bool accept_process(name_id proc, double t) const {
+    if ( t < tmin_ || t > tmax_ )
+      return false;
+    const uint8_t act = proc < procs_.size() ? procs_[proc] : 0U;
+    return act == allowed || ( act == 0U && !procAllowList_ );
+  }
+
+  /**
+  * @brief check if an accepted step is recorded for its deposit alone
+  */
+  bool accept_deposit(double eDep) const { return eDep >= minDeposit_; }
+
+  /**
+  * @brief check if a secondary of an accepted step is recorded
+  * @param[in] pdg the particle code
+  * @param[in] E the total energy
+  * @param[in] depth the generation of the secondary
+  */
+  bool accept_track(int pdg, double E, unsigned depth) const;
+
+private:
+
+  // process and particle actions
+  static const uint8_t allowed = 1U;
+  static const uint8_t denied = 2U;
+
+  // thresholds
+  double minDeposit_;
+  double minTrackEnergy_;
+  unsigned maxDepth_;
+  double tmin_, tmax_;
+
+  // process actions by name id
+  std::vector<uint8_t> procs_;
+  bool procAllowList_;
+
+  // allowed and denied particles (sorted)
+  std::vector<int> allowedPdgs_;
+  std::vector<int> deniedPdgs_;
+
+};
+
+}
+
+#endif
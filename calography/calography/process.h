@@ -9,8 +9,10 @@
 
 // --- includes ---
 #include "node.h"
+#include "names.h"
 
 #include <string>
+#include <string_view>
 
 namespace cg {
 
@@ -19,6 +21,7 @@ namespace cg {
 * @details The process node captures a physics process implemented and limiting a step in a Geant4 simulation.
 * Analyzing the graph and summing energy deposition and physical extents of the graph below
 * a process can be used to understand the shape of sub-showers within a calorimeter.
+* The name is interned in process_names(), the node only holds its id.
 */
 class process : public node {
 public:
@@ -28,6 +31,7 @@ public:
   */
   process()
     :node(processNode)
+    ,procId_(0U)
   { }
 
   /**
@@ -35,7 +39,7 @@ public:
   */
   process(const process & proc)
     :node(proc)
-    ,procName_(proc.procName_)
+    ,procId_(proc.procId_)
   { }
 
   /**
@@ -43,47 +47,73 @@ public:
   */
    process(const std::string name, double E, const relvec& rc)
     :node(processNode,E,rc)
-    ,procName_(name)
+    ,procId_(process_names().intern(name))
+  { }
+
+  /**
+  * @brief construct with an interned name.
+  */
+  process(name_id id, double E, const relvec& rc)
+    :node(processNode,E,rc)
+    ,procId_(id)
   { }
   
 
 
-  /** 
-  * @brief print some basic information about this node.
+  /**
+  * @brief print some basic information about this node (no children).
   */
-  virtual void print(int lvl=0) const; 
+  virtual void print_node(int lvl=0) const;
 
+  /**
+  * @brief serialize the process fields (text format)
+  */
+  virtual void serialize_fields(std::ostream &) const;
 
+  /**
+  * @brief deserialize the process fields (text format)
+  */
+  virtual void deserialize_fields(std::istream &);
 
   /**
-  * @brief serialize the process node
+  * @brief write the process fields (binary format)
   */
-  virtual void serialize(std::ostream &) const;
+  virtual void write_fields(bin::obuffer &) const;
 
   /**
-  * @brief deserialize the process node
+  * @brief read the process fields (binary format)
   */
-  virtual void deserialize(std::istream &);
+  virtual void read_fields(bin::ibuffer &);
 
 
   // --- new setters
   /**
   * @brief set the process name.
   */
-  virtual void set_name(const std::string & name) { procName_ = name; }
+  virtual void set_name(std::string_view name) { procId_ = process_names().intern(name); }
+
+  /**
+  * @brief set the id of the (interned) process name.
+  */
+  virtual void set_name_index(name_id id) { procId_ = id; }
 
 
   // --- new getters
   /**
   * @brief get the process name
   */
-  const virtual std::string & name() const { return procName_; }
+  virtual std::string_view name() const { return process_names().name(procId_); }
+
+  /**
+  * @brief get the id of the process name in process_names()
+  */
+  virtual name_id name_index() const { return procId_; }
 
 
 protected: 
 
-  // process name
-  std::string procName_;
+  // process name id
+  name_id procId_;
 
 }; 
 
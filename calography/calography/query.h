@@ -0,0 +1,310 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+/**
+* @file query.h
+* @author C S Cowden
+* @brief Declare node filters (composable predicates) and their compiled
+* form, which selects nodes of a compact graph.
+*/
+
+// --- includes ---
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "nodetypes.h"
+#include "compact.h"
+
+namespace cg {
+
+/**
+* @brief Node filter
+* @details A predicate on the nodes of a graph, built from the factories
+* below and combined with &&, || and ! (which build the expression, they
+* do not short-circuit).  Ranges are [lo,hi).  A filter is compiled (see
+* compiled_filter) into a program which is run column by column over a
+* compact graph.  For example the neutral pions above 1 GeV created by a
+* hadronic inelastic process before 5 ns:
+* @code
+*   cg::node_filter pi0 = cg::node_filter::pdg(111)
+*     && cg::node_filter::track_energy(1000.)
+*     && cg::node_filter::created_by("hadInelastic")
+*     && cg::node_filter::time(0.,5.);
+*   cg::compiled_filter sel(pi0);
+*   for ( cg::compact_graph::index i : sel.select(graph) )
+*     ...
+* @endcode
+*/
+class node_filter {
+public:
+
+  /**
+  * @brief operations of a filter
+  */
+  enum op_code {
+    opAll,            // every node
+    opNone,           // no node
+    opType,           // node type (value is a mask of types)
+    opId,             // node id
+    opPdg,            // tracks of a particle code
+    opProcess,        // process nodes of a name
+    opEnergy,         // node energy in a range
+    opTrackEnergy,    // tracks of a total energy in a range
+    opTime,           // time in a range
+    opX,              // position in a range
+    opY,
+    opZ,
+    opDepth,          // depth in a range
+    opParent,         // the parent is selected by a
+    opAncestor,       // an ancestor is selected by a
+    opNot,            // not a
+    opAnd,            // a and b
+    opOr              // a or b
+  };
+
+  /**
+  * @brief default constructor (selects every node)
+  */
+  node_filter():node_filter(opAll) { }
+
+  // --- factories ---
+
+  static node_filter all() { return node_filter(opAll); }
+  static node_filter none() { return node_filter(opNone); }
+
+  /**
+  * @brief nodes of a type
+  */
+  static node_filter type(node_type t) { return node_filter(opType,0.,0.,int64_t(1) << t); }
+
+  /**
+  * @brief tracks and trajectories
+  */
+  static node_filter tracks() {
+    return node_filter(opType,0.,0.,(int64_t(1) << trackNode) | (int64_t(1) << trajectoryNode));
+  }
+
+  /**
+  * @brief process nodes
+  */
+  static node_filter processes() { return type(processNode); }
+
+  /**
+  * @brief the node of an id
+  */
+  static node_filter id(node_id nid) { return node_filter(opId,0.,0.,int64_t(nid)); }
+
+  /**
+  * @brief tracks of a particle code
+  */
+  static node_filter pdg(int code) { return node_filter(opPdg,0.,0.,code); }
+
+  /**
+  * @brief process nodes of a process name
+  */
+  static node_filter process(const std::string & name) {
+    node_filter f(opProcess);
+    f.term_->name = name;
+    return f;
+  }
+
+  /**
+  * @brief nodes of an (deposited) energy in [lo,hi)
+  */
+  static node_filter energy(double lo, double hi=inf()) { return node_filter(opEnergy,lo,hi); }
+
+  /**
+  * @brief tracks of a total particle energy in [lo,hi)
+  */
+  static node_filter track_energy(double lo, double hi=inf()) { return node_filter(opTrackEnergy,lo,hi); }
+
+  /**
+  * @brief nodes of a time in [lo,hi)
+  */
+  static node_filter time(double lo, double hi=inf()) { return node_filter(opTime,lo,hi); }
+
+  /**
+  * @brief nodes of a position in [lo,hi) along an axis
+  */
+  static node_filter x(double lo, double hi=inf()) { return node_filter(opX,lo,hi); }
+  static node_filter y(double lo, double hi=inf()) { return node_filter(opY,lo,hi); }
+  static node_filter z(double lo, double hi=inf()) { return node_filter(opZ,lo,hi); }
+
+  /**
+  * @brief nodes in a box (the spatial components of lo and hi)
+  */
+  static node_filter box(const relvec & lo, const relvec & hi) {
+    return x(lo.x_,hi.x_) && y(lo.y_,hi.y_) && z(lo.z_,hi.z_);
+  }
+
+  /**
+  * @brief nodes of a depth in [lo,hi) (the root has depth 0)
+  */
+  static node_filter depth(unsigned lo, unsigned hi=std::numeric_limits<unsigned>::max()) {
+    return node_filter(opDepth,lo,hi);
+  }
+
+  /**
+  * @brief nodes whose parent is selected by a filter
+  */
+  static node_filter parent(const node_filter & f) { return node_filter(opParent,f,nullptr); }
+
+  /**
+  * @brief nodes with an ancestor (not the node itself) selected by a filter
+  */
+  static node_filter ancestor(const node_filter & f) { return node_filter(opAncestor,f,nullptr); }
+
+  /**
+  * @brief tracks created (or continued) by a process of a name
+  */
+  static node_filter created_by(const std::string & process_name) {
+    return tracks() && parent(process(process_name));
+  }
+
+  // --- composition ---
+
+  friend node_filter operator&&(const node_filter & a, const node_filter & b) { return node_filter(opAnd,a,b.term_); }
+  friend node_filter operator||(const node_filter & a, const node_filter & b) { return node_filter(opOr,a,b.term_); }
+  friend node_filter operator!(const node_filter & a) { return node_filter(opNot,a,nullptr); }
+
+  /**
+  * @brief compile and select the nodes of a compact graph (see compiled_filter)
+  */
+  std::vector<compact_graph::index> select(const compact_graph & g) const;
+
+private:
+  friend class compiled_filter;
+
+  /**
+  * @brief a term of the expression
+  */
+  struct term {
+    op_code op;
+    double lo, hi;
+    int64_t value;
+    std::string name;
+    std::shared_ptr<const term> a, b;
+  };
+
+  /**
+  * @brief construct a leaf
+  */
+  explicit node_filter(op_code op, double lo=0., double hi=0., int64_t value=0)
+    :term_(std::make_shared<term>(term{op,lo,hi,value,std::string(),nullptr,nullptr}))
+  { }
+
+  /**
+  * @brief construct an operation on filters (b is NULL for unary operations)
+  */
+  node_filter(op_code op, const node_filter & a, const std::shared_ptr<const term> & b)
+    :term_(std::make_shared<term>(term{op,0.,0.,0,std::string(),a.term_,b}))
+  { }
+
+  static double inf() { return std::numeric_limits<double>::infinity(); }
+
+  // the expression (terms are shared by the filters built from them)
+  std::shared_ptr<term> term_;
+
+};
+
+
+/**
+* @brief Compiled node filter
+* @details The expression of a filter is flattened into a postfix program
+* of column operations.  Running it computes a selection mask over all
+* nodes of a compact graph, one operation at a time: a predicate on a
+* column is a tight loop over the column, combined in place with the mask
+* below it when it is the right operand of && or ||; parents and
+* ancestors are one pass in depth-first order (parents come before their
+* children).  Constant terms are folded when compiling.  A compiled
+* filter does not change when run, so threads may share it.
+*/
+class compiled_filter {
+public:
+
+  typedef compact_graph::index index;
+
+  /**
+  * @brief default constructor (selects every node)
+  */
+  compiled_filter():compiled_filter(node_filter()) { }
+
+  /**
+  * @brief compile a filter
+  */
+  explicit compiled_filter(const node_filter & f);
+
+  /**
+  * @brief compute the selection mask of a graph
+  * @param[out] mask 1 for the selected nodes, 0 for the others
+  */
+  void mask(const compact_graph & g, std::vector<uint8_t> & mask) const;
+
+  /**
+  * @brief get the indices of the selected nodes, in increasing order
+  */
+  std::vector<index> select(const compact_graph & g) const;
+
+  /**
+  * @brief count the selected nodes
+  */
+  size_t count(const compact_graph & g) const;
+
+  /**
+  * @brief get the number of operations of the program
+  */
+  size_t size() const { return code_.size(); }
+
+private:
+
+  /**
+  * @brief how an operation stores its result
+  */
+  enum store_mode {
+    storePush,        // on a new mask
+    storeAnd,         // and with the top mask
+    storeOr           // or with the top mask
+  };
+
+  /**
+  * @brief an operation of the program
+  */
+  struct instruction {
+    node_filter::op_code op;
+    store_mode mode;
+    double lo, hi;
+    int64_t value;
+    std::string name;
+  };
+
+  typedef std::shared_ptr<const node_filter::term> term_ptr;
+
+  /**
+  * @brief fold the constant terms of an expression
+  */
+  static term_ptr fold(const term_ptr & t);
+
+  /**
+  * @brief append the program of an expression
+  * @return the number of masks used
+  */
+  unsigned emit(const node_filter::term & t, store_mode mode);
+
+  /**
+  * @brief run the program
+  * @param[out] stack the masks, the first holds the result
+  */
+  void run(const compact_graph & g, std::vector<std::vector<uint8_t> > & stack) const;
+
+  // the program and the number of masks it uses
+  std::vector<instruction> code_;
+  unsigned depth_;
+
+};
+
+}
+
+#endif
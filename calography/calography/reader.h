@@ -0,0 +1,172 @@
+#ifndef READER_H
+#define READER_H
+
+/**
+* @file reader.h
+* @author C S Cowden
+* @brief Declare a streaming reader of graph collections.
+*/
+
+// --- includes ---
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+
+#include "CaloGraphyIO.h"
+
+namespace cg {
+
+/**
+* @brief Streaming collection reader
+* @details Read the event graphs of a file one at a time.  The reader owns
+* the current graph and deletes it when the next one is read, so memory is
+* bounded by the largest event regardless of the size of the file.
+* Call release() to keep a graph.  Both the text and binary formats are
+* supported.  In pooled mode (set_pooled()) the graphs are allocated from
+* an arena which is reset, rather than walking and deleting the graph,
+* when the next one is read; pooled graphs can not be released.
+* @code
+*   cg::collection_reader reader("run1.cg");
+*   for ( cg::node * nd : reader ) {
+*     ...
+*   }
+* @endcode
+*/
+class collection_reader {
+public:
+
+  /**
+  * @brief input iterator over the events of a reader
+  */
+  class iterator {
+  public:
+    typedef std::input_iterator_tag iterator_category;
+    typedef node * value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef node * const * pointer;
+    typedef node * const & reference;
+
+    iterator():reader_(NULL),node_(NULL) { }
+    explicit iterator(collection_reader * rd):reader_(rd),node_(rd->next()) { }
+
+    reference operator*() const { return node_; }
+    iterator & operator++() { node_ = reader_->next(); return *this; }
+
+    bool operator==(const iterator & it) const { return node_ == it.node_; }
+    bool operator!=(const iterator & it) const { return node_ != it.node_; }
+
+  private:
+    collection_reader * reader_;
+    node * node_;
+  };
+
+  /**
+  * @brief default constructor
+  */
+  collection_reader():fmt_(textFormat),version_(bin::version),current_(NULL),nread_(0U),pooled_(false) { }
+
+  /**
+  * @brief construct and open a file
+  */
+  explicit collection_reader(const std::string & name)
+    :fmt_(textFormat),version_(bin::version),current_(NULL),nread_(0U),pooled_(false)
+  { open(name); }
+
+  /**
+  * @brief destructor (deletes the current graph)
+  */
+  ~collection_reader() { close(); }
+
+  // the reader is not copyable
+  collection_reader(const collection_reader &) = delete;
+  collection_reader & operator=(const collection_reader &) = delete;
+
+  /**
+  * @brief open a file (the format is determined from the file)
+  * @return false if the file can not be read.
+  */
+  bool open(const std::string & name);
+
+  /**
+  * @brief close the file and delete the current graph
+  */
+  void close();
+
+  /**
+  * @brief check if a file is open
+  */
+  bool is_open() const { return in_.is_open(); }
+
+  /**
+  * @brief read the next event graph
+  * @details The previous graph is deleted unless it was released.
+  * @return The graph, or NULL at the end of the file.
+  */
+  node * next();
+
+  /**
+  * @brief take ownership of the current graph
+  */
+  node * release() { assert(!pooled_); node * nd = current_; current_ = NULL; return nd; }
+
+  /**
+  * @brief allocate the graphs from an arena which is reset for each event
+  */
+  void set_pooled(bool pool) { pooled_ = pool; }
+
+  /**
+  * @brief check if the graphs are allocated from an arena
+  */
+  bool pooled() const { return pooled_; }
+
+  /**
+  * @brief get the number of graphs read so far
+  */
+  size_t count() const { return nread_; }
+
+  /**
+  * @brief get the format of the file
+  */
+  io_format format() const { return fmt_; }
+
+  /**
+  * @brief iterate over the remaining events
+  */
+  iterator begin() { return iterator(this); }
+  iterator end() { return iterator(); }
+
+private:
+
+  /**
+  * @brief drop the current graph
+  */
+  void drop();
+
+  // the file
+  std::ifstream in_;
+  io_format fmt_;
+
+  // format version (binary format)
+  uint32_t version_;
+
+  // the current graph
+  node * current_;
+
+  // number of graphs read
+  size_t nread_;
+
+  // chunk buffers and names of the file (binary format)
+  std::vector<char> payload_, raw_;
+  name_map names_;
+  bin::vector_coding coding_;
+
+  // event arena (pooled mode)
+  bool pooled_;
+  arena pool_;
+
+};
+
+}
+
+#endif
@@ -0,0 +1,212 @@
+#ifndef STATS_H
+#define STATS_H
+
+/**
+* @file stats.h
+* @author C S Cowden
+* @brief Declare the statistics of graph building and writing.
+*/
+
+// --- includes ---
+#include <cmath>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "names.h"
+
+namespace cg {
+
+/**
+* @brief Histogram on a log2 scale
+* @details Bin k counts the values in [2^k,2^(k+1)), bin 0 also the
+* values below 1.  Durations are recorded in nanoseconds.
+*/
+struct log_histogram {
+
+  /// number of bins
+  static const unsigned nbins = 48U;
+
+  /**
+  * @brief constructor (empty)
+  */
+  log_histogram() { clear(); }
+
+  /**
+  * @brief add a value
+  */
+  void add(double v) {
+    const int k = v < 1. ? 0 : std::ilogb(v);
+    bins[k < int(nbins) ? k : nbins-1U]++;
+    count++;
+    sum += v;
+    if ( v > max )
+      max = v;
+  }
+
+  /**
+  * @brief add the values of another histogram
+  */
+  void merge(const log_histogram & h);
+
+  /**
+  * @brief remove all values
+  */
+  void clear();
+
+  /**
+  * @brief write as a JSON object
+  */
+  void write_json(std::ostream & out) const;
+
+  uint64_t bins[nbins];
+  uint64_t count;
+  double sum;
+  double max;
+};
+
+/**
+* @brief Counters of the steps of one process or particle
+*/
+struct step_counters {
+  uint64_t steps = 0U;    // number of steps
+  uint64_t nodes = 0U;    // nodes created by the steps
+  double edep = 0.;       // energy deposited by the steps
+  log_histogram time;     // time spent building the graph (ns)
+
+  /**
+  * @brief add the counters of another process or particle
+  */
+  void merge(const step_counters & c);
+};
+
+
+/**
+* @brief Statistics of graph building and writing
+* @details Collected by CGG4Interface (see set_stats()) in one object per
+* thread, so recording a step takes no lock; the objects of the threads
+* are merged at the end of the run.  Records per process name and per
+* particle code the number of steps, nodes created, energy deposited and
+* a histogram of the time taken to add the steps to the graph.  Per event
+* the numbers of nodes and bytes written are histogrammed.  Merge and
+* write durations are recorded in nanoseconds.
+*/
+class build_stats {
+public:
+
+  /**
+  * @brief constructor (empty)
+  */
+  build_stats() { clear(); }
+
+  /**
+  * @brief record a step
+  * @param[in] proc the process limiting the step
+  * @param[in] pdg the particle code
+  * @param[in] nodes the number of nodes created by the step
+  * @param[in] edep the energy deposited
+  * @param[in] ns the time taken to add the step to the graph
+  * @param[in] depth the depth of the track stack after the step
+  */
+  void add_step(name_id proc, int pdg, uint64_t nodes, double edep, double ns, size_t depth) {
+    if ( proc >= procs_.size() )
+      procs_.resize(proc+1U);
+    add(procs_[proc],nodes,edep,ns);
+    add(particles_[pdg],nodes,edep,ns);
+    add(steps_,nodes,edep,ns);
+    if ( depth > maxStack_ )
+      maxStack_ = depth;
+  }
+
+  /**
+  * @brief record the number of nodes of a finished event
+  */
+  void add_event(uint64_t nodes) { eventNodes_.add(double(nodes)); }
+
+  /**
+  * @brief record the bytes written for an event
+  */
+  void add_event_bytes(uint64_t bytes) { eventBytes_.add(double(bytes)); }
+
+  /**
+  * @brief record the duration of a merge (ns)
+  */
+  void add_merge(double ns) { merge_.add(ns); }
+
+  /**
+  * @brief record the duration of a write (ns) and the bytes written
+  */
+  void add_write(double ns, uint64_t bytes) {
+    write_.add(ns);
+    bytes_ += bytes;
+  }
+
+  /**
+  * @brief add the statistics of another thread
+  */
+  void merge(const build_stats & st);
+
+  /**
+  * @brief remove all statistics
+  */
+  void clear();
+
+  /**
+  * @brief write as JSON
+  */
+  void write_json(std::ostream & out) const;
+
+  /**
+  * @brief write as JSON to a file
+  * @return false if the file can not be opened
+  */
+  bool write_json(const std::string & name) const;
+
+  // --- getters ---
+
+  const step_counters & steps() const { return steps_; }
+  const std::vector<step_counters> & processes() const { return procs_; }
+  const std::unordered_map<int,step_counters> & particles() const { return particles_; }
+  const log_histogram & event_nodes() const { return eventNodes_; }
+  const log_histogram & event_bytes() const { return eventBytes_; }
+  const log_histogram & merges() const { return merge_; }
+  const log_histogram & writes() const { return write_; }
+  uint64_t bytes() const { return bytes_; }
+  size_t max_stack_depth() const { return maxStack_; }
+
+private:
+
+  /**
+  * @brief add a step to the counters
+  */
+  static void add(step_counters & c, uint64_t nodes, double edep, double ns) {
+    c.steps++;
+    c.nodes += nodes;
+    c.edep += edep;
+    c.time.add(ns);
+  }
+
+  // steps: all, per process name id and per particle code
+  step_counters steps_;
+  std::vector<step_counters> procs_;
+  std::unordered_map<int,step_counters> particles_;
+
+  // events
+  log_histogram eventNodes_;
+  log_histogram eventBytes_;
+
+  // merges and writes
+  log_histogram merge_;
+  log_histogram write_;
+  uint64_t bytes_;
+
+  // deepest track stack
+  size_t maxStack_;
+
+};
+
+}
+
+#endif
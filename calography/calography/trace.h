@@ -0,0 +1,184 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/**
+* @file trace.h
+* @author C S Cowden
+* @brief Declare the step trace recorder and reader.
+* @details A step trace holds the step records (see builder.h) of a run,
+* so graph building can be replayed and timed without Geant4.  The file
+* is laid out as follows (all values little-endian).
+*  * file header: magic "CGTR", u32 version
+*  * a sequence of events: u64 payload length, payload
+*  * the payload of an event is a sequence of items, each starting with a
+*    u8 kind:
+*    * a name item maps a name id of the file to a name: u16 id, u16
+*      length and characters.  It precedes the first step using the name.
+*    * a step item: i32 track id, i32 pdg, u8 status, pre-step position
+*      and momentum, post-step position and momentum (four f64 each),
+*      u16 process name id, f64 deposit, u32 number of secondaries, then
+*      i32 pdg and momentum (four f64) for each secondary.
+*/
+
+// --- includes ---
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "binio.h"
+#include "builder.h"
+
+namespace cg {
+
+namespace trace {
+
+/**
+* @brief file magic
+*/
+const char magic[4] = { 'C', 'G', 'T', 'R' };
+
+/**
+* @brief current format version
+*/
+const uint32_t version = 1U;
+
+/**
+* @brief kinds of the items of an event
+*/
+const uint8_t nameItem = 1U;
+const uint8_t stepItem = 2U;
+
+}
+
+
+/**
+* @brief Step trace recorder
+* @details Records the steps of each event; an event is written when the
+* next one starts or the recorder is closed.  Not thread-safe, use one
+* recorder (and file) per thread.
+*/
+class step_recorder {
+public:
+
+  /**
+  * @brief constructor (no file)
+  */
+  step_recorder():open_(false),event_(false) { }
+
+  /**
+  * @brief destructor (closes the file)
+  */
+  ~step_recorder() { close(); }
+
+  // the recorder is not copyable
+  step_recorder(const step_recorder &) = delete;
+  step_recorder & operator=(const step_recorder &) = delete;
+
+  /**
+  * @brief open a trace file (closes the previous one)
+  * @return false if the file can not be opened
+  */
+  bool open(const std::string & name);
+
+  /**
+  * @brief write the current event and close the file
+  */
+  void close();
+
+  /**
+  * @brief check if a file is open
+  */
+  bool is_open() const { return open_; }
+
+  /**
+  * @brief start an event (writes the previous one)
+  */
+  void start_event();
+
+  /**
+  * @brief record a step of the current event
+  */
+  void record(const step_record & st);
+
+  /**
+  * @brief write the current event
+  */
+  void end_event();
+
+private:
+
+  // output file
+  std::ofstream out_;
+  bool open_;
+
+  // payload of the current event
+  bin::obuffer buf_;
+  bool event_;
+
+  // name ids already written to the file
+  std::vector<bool> names_;
+
+};
+
+
+/**
+* @brief Step trace reader
+*/
+class step_trace {
+public:
+
+  /**
+  * @brief constructor (no file)
+  */
+  step_trace() { }
+
+  /**
+  * @brief construct and open a file
+  */
+  explicit step_trace(const std::string & name) { open(name); }
+
+  /**
+  * @brief open a trace file
+  * @return false if the file can not be opened or is not a trace
+  */
+  bool open(const std::string & name);
+
+  /**
+  * @brief check if a file is open
+  */
+  bool is_open() const { return in_.is_open(); }
+
+  /**
+  * @brief read the steps of the next event
+  * @param[out] steps the steps (replaced)
+  * @return false at the end of the file
+  */
+  bool next_event(std::vector<step_record> & steps);
+
+private:
+
+  // input file
+  std::ifstream in_;
+
+  // payload of the current event
+  std::vector<char> payload_;
+
+  // name ids of the file to ids of process_names()
+  name_map names_;
+
+};
+
+/**
+* @brief feed the steps of an event to a graph builder
+* @return the root of the graph
+*/
+inline track * replay(const std::vector<step_record> & steps, graph_builder & builder) {
+  builder.start_event();
+  for ( const step_record & st : steps )
+    builder.process_step(st);
+  return builder.root();
+}
+
+}
+
+#endif
@@ -52,21 +52,36 @@ public:
     ,momentum_(mom)
   { }
 
+  /**
+  * @brief check if a node type is a track (or derives from track)
+  */
+  static bool is_track(node_type nt) { return nt == trackNode || nt == trajectoryNode; }
+
+
+  /**
+  * @brief print some basic information about this node (no children).
+  */
+  virtual void print_node(int lvl=0) const;
 
   /**
-  * @brief print some basic information about this node.
+  * @brief serialize the track fields (text format)
   */
-  virtual void print(int lvl=0) const;
+  virtual void serialize_fields(std::ostream &) const;
 
   /**
-  * @brief serialize the track node
+  * @brief deserialize the track fields (text format)
   */
-  virtual void serialize(std::ostream &) const;
+  virtual void deserialize_fields(std::istream &);
 
   /**
-  * @brief deserialize the track node
+  * @brief write the track fields (binary format)
   */
-  virtual void deserialize(std::istream &);
+  virtual void write_fields(bin::obuffer &) const;
+
+  /**
+  * @brief read the track fields (binary format)
+  */
+  virtual void read_fields(bin::ibuffer &);
 
   // --- new setters ---
   /**
@@ -103,6 +118,23 @@ public:
 
 protected:
 
+  /**
+  * @brief construct a derived node type
+  */
+  track(node_type nt)
+    :node(nt)
+  { }
+
+  /**
+  * @brief construct a derived node type with some data.
+  */
+  track(node_type nt, int pdg, unsigned g4trackid, const relvec &mom, double E, const relvec& rc)
+    :node(nt,E,rc)
+    ,pdgid_(pdg)
+    ,g4trackid_(g4trackid)
+    ,momentum_(mom)
+  { }
+
   // identify the particle type by pdg code
   int pdgid_;
 
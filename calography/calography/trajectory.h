@@ -0,0 +1,122 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+/**
+* @file trajectory.h
+* @author C S Cowden
+* @brief Declare the trajectory class (a track with its step points).
+*/
+
+// --- includes ---
+#include <vector>
+#include <memory_resource>
+
+#include "track.h"
+#include "names.h"
+
+namespace cg {
+
+/**
+* @brief the end point of a step of a trajectory
+*/
+struct step_point {
+  relvec pos;        // position and time at the end of the step
+  float energy;      // energy deposited in the step
+  name_id process;   // process limiting the step (see process_names())
+};
+
+/**
+* @brief list of step points (allocated from the same arena as the node)
+*/
+typedef std::pmr::vector<step_point> step_list;
+
+
+/**
+* @brief Trajectory class - track specialization
+* @details A trajectory records a particle over many steps in one node:
+* the steps are kept as a polyline of step points instead of a chain of
+* process and track nodes.  The particle only branches (through a process
+* node) where secondaries are produced; the process node carries the
+* position and time of the branching step.  The energy of the node is the
+* sum of the deposits of its steps.
+*/
+class trajectory : public track {
+public:
+
+  /**
+  * @brief default constructor
+  */
+  trajectory()
+    :track(trajectoryNode)
+    ,steps_(arena::resource())
+  { }
+
+  /**
+  * @brief copy constructor
+  */
+  trajectory(const trajectory & trj)
+    :track(trj)
+    ,steps_(trj.steps_,arena::resource())
+  { }
+
+  /**
+  * @brief construct with some data.
+  */
+  trajectory(int pdg, unsigned g4trackid, const relvec &mom, double E, const relvec& rc)
+    :track(trajectoryNode,pdg,g4trackid,mom,E,rc)
+    ,steps_(arena::resource())
+  { }
+
+
+  /**
+  * @brief print some basic information about this node (no children).
+  */
+  virtual void print_node(int lvl=0) const;
+
+  /**
+  * @brief serialize the trajectory fields (text format)
+  */
+  virtual void serialize_fields(std::ostream &) const;
+
+  /**
+  * @brief deserialize the trajectory fields (text format)
+  */
+  virtual void deserialize_fields(std::istream &);
+
+  /**
+  * @brief write the trajectory fields (binary format)
+  */
+  virtual void write_fields(bin::obuffer &) const;
+
+  /**
+  * @brief read the trajectory fields (binary format)
+  */
+  virtual void read_fields(bin::ibuffer &);
+
+
+  // --- new setters ---
+  /**
+  * @brief append a step point (the energy of the node is not changed).
+  */
+  virtual void add_step(const relvec & pos, float E, name_id proc) {
+    steps_.push_back(step_point{pos,E,proc});
+    invalidate();
+  }
+
+  // --- new getters ---
+  /**
+  * @brief get the step points
+  */
+  const step_list & steps() const { return steps_; }
+
+
+protected:
+
+  // step points
+  step_list steps_;
+
+};
+
+}
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef TRAVERSE_H
+#define TRAVERSE_H
+
+/**
+* @file traverse.h
+* @author C S Cowden
+* @brief Non-recursive graph traversal with a visitor.
+* @details A visitor provides pre- and post-order callbacks which are
+* called with the node cast to its concrete class (node, track, trajectory
+* or process)
+* according to its node type, so a visitor can overload on the class:
+* @code
+*   struct counter : public cg::visitor {
+*     using cg::visitor::pre;
+*     unsigned ntracks = 0;
+*     cg::visit_action pre(const cg::track & trk, unsigned depth) {
+*       ntracks++;
+*       return cg::visitContinue;
+*     }
+*   };
+*   counter cnt;
+*   cg::traverse(root,cnt);
+* @endcode
+* The traversal keeps an explicit stack, so the depth of a graph is only
+* limited by memory.
+*/
+
+// --- includes ---
+#include <vector>
+#include <type_traits>
+
+#include "node.h"
+#include "track.h"
+#include "process.h"
+#include "trajectory.h"
+#include "nodetypes.h"
+
+namespace cg {
+
+/**
+* @brief action returned by a pre-order callback
+* @details
+*  * visitContinue: visit the children of the node
+*  * visitSkip: do not visit the children (the post-order callback is still called)
+*  * visitStop: end the traversal
+*/
+enum visit_action {
+  visitContinue,
+  visitSkip,
+  visitStop
+};
+
+/**
+* @brief Default (empty) visitor callbacks.
+*/
+struct visitor {
+
+  /**
+  * @brief pre-order callback
+  * @param[in] nd the node (as its concrete class)
+  * @param[in] depth depth relative to the start of the traversal
+  */
+  template<typename N>
+  visit_action pre(N &, unsigned) { return visitContinue; }
+
+  /**
+  * @brief post-order callback
+  * @param[in] nd the node (as its concrete class)
+  * @param[in] depth depth relative to the start of the traversal
+  */
+  template<typename N>
+  void post(N &, unsigned) { }
+
+};
+
+/**
+* @brief Call a function with a node cast to its concrete class.
+* @param[in] nd the node (const or not)
+* @param[in] f a callable accepting node, track, trajectory and process references
+*/
+template<typename N, typename F>
+inline decltype(auto) dispatch(N * nd, F && f) {
+  typedef typename std::conditional<std::is_const<N>::value,const track,track>::type track_t;
+  typedef typename std::conditional<std::is_const<N>::value,const process,process>::type process_t;
+  typedef typename std::conditional<std::is_const<N>::value,const trajectory,trajectory>::type trajectory_t;
+
+  switch ( nd->type() ) {
+  case trackNode:
+    return f(static_cast<track_t &>(*nd));
+  case processNode:
+    return f(static_cast<process_t &>(*nd));
+  case trajectoryNode:
+    return f(static_cast<trajectory_t &>(*nd));
+  default:
+    return f(*nd);
+  }
+}
+
+/**
+* @brief Depth-first traversal of the sub-graph below a node.
+* @param[in] root the node to start from (const or not)
+* @param[in] v the visitor
+* @return false if the traversal was stopped by the visitor.
+*/
+template<typename N, typename V>
+bool traverse(N * root, V & v) {
+
+  struct frame {
+    N * nd;
+    size_t next;
+    unsigned depth;
+  };
+
+  if ( !root )
+    return true;
+
+  std::vector<frame> stack;
+
+  // visit a node, push it if its children are to be visited
+  auto enter = [&](N * nd, unsigned depth) {
+    const visit_action act = dispatch(nd,[&](auto & n) { return v.pre(n,depth); });
+    if ( act == visitContinue )
+      stack.push_back(frame{nd,0U,depth});
+    else if ( act == visitSkip )
+      dispatch(nd,[&](auto & n) { v.post(n,depth); });
+    return act != visitStop;
+  };
+
+  if ( !enter(root,0U) )
+    return false;
+
+  while ( !stack.empty() ) {
+    frame & f = stack.back();
+    const node_list & kids = f.nd->children();
+    if ( f.next != kids.size() ) {
+      N * child = kids[f.next++];
+      if ( !enter(child,f.depth+1U) )
+        return false;
+    } else {
+      N * nd = f.nd;
+      const unsigned depth = f.depth;
+      stack.pop_back();
+      dispatch(nd,[&](auto & n) { v.post(n,depth); });
+    }
+  }
+
+  return true;
+}
+
+}
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef TRIGGER_H
+#define TRIGGER_H
+
+/**
+* @file trigger.h
+* @author C S Cowden
+* @brief Declare the event summary, prescale and triggers deciding which
+* event graphs are recorded.
+*/
+
+// --- includes ---
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace cg {
+
+class node;
+
+/**
+* @brief Summary of an event, kept whether or not its graph is recorded
+*/
+struct event_summary {
+  uint64_t event;          // event number (per thread)
+  int thread;              // thread id (-1 for the master or a serial application)
+  int primary_pdg;         // particle code of the primary
+  double primary_energy;   // total energy of the primary
+  double edep;             // energy deposited in all steps
+  uint64_t steps;          // number of steps
+  uint64_t secondaries;    // number of secondaries
+  uint64_t nodes;          // number of nodes of the graph (0 if not built)
+  double tmax;             // latest post-step time
+  uint32_t triggers;       // mask of the triggers which fired
+  bool recorded;           // is the graph recorded
+};
+
+/**
+* @brief trigger predicate, evaluated on the graph of an event at its end
+*/
+typedef std::function<bool(const node & root, const event_summary & summary)> event_trigger;
+
+
+/**
+* @brief Event selection (prescale and triggers)
+* @details With a prescale of N only every N-th event (counting from 0)
+* has its graph built.  The graph of a built event is recorded if any
+* trigger fires, or always if there are no triggers.  A trigger sees the
+* graph and the summary of the event, e.g. for a late hadronic interaction:
+* @code
+*   sel.add_trigger("late_had",[](const cg::node & root, const cg::event_summary &) {
+*     for ( const cg::node * nd : root.shower() )
+*       if ( nd->type() == cg::processNode && nd->pos().t_ > 100.
+*           && static_cast<const cg::process *>(nd)->name() == "hadInelastic" )
+*         return true;
+*     return false;
+*   });
+* @endcode
+*/
+class event_selector {
+public:
+
+  /// maximum number of triggers
+  static const unsigned maxTriggers = 32U;
+
+  /**
+  * @brief constructor (every event is recorded)
+  */
+  event_selector():prescale_(1U) { }
+
+  /**
+  * @brief build only every n-th graph (0 and 1 build every graph)
+  */
+  void set_prescale(unsigned n) { prescale_ = n; }
+
+  /**
+  * @brief add a trigger
+  * @return false if there are already maxTriggers triggers
+  */
+  bool add_trigger(const std::string & name, const event_trigger & trig);
+
+  /**
+  * @brief remove the triggers
+  */
+  void clear_triggers() {
+    names_.clear();
+    triggers_.clear();
+  }
+
+  // --- getters ---
+
+  unsigned prescale() const { return prescale_; }
+  const std::vector<std::string> & trigger_names() const { return names_; }
+
+  /**
+  * @brief check if events are selected (by prescale or triggers)
+  */
+  bool active() const { return prescale_ > 1U || !triggers_.empty(); }
+
+  /**
+  * @brief check if the graph of an event is built
+  */
+  bool prescaled(uint64_t event) const { return prescale_ <= 1U || event % prescale_ == 0U; }
+
+  /**
+  * @brief evaluate the triggers
+  * @return the mask of the triggers which fired
+  */
+  uint32_t evaluate(const node & root, const event_summary & summary) const;
+
+  /**
+  * @brief check if a built graph is recorded
+  */
+  bool accept(uint32_t fired) const { return triggers_.empty() || fired != 0U; }
+
+private:
+
+  // prescale
+  unsigned prescale_;
+
+  // triggers and their names
+  std::vector<std::string> names_;
+  std::vector<event_trigger> triggers_;
+
+};
+
+/**
+* @brief write event summaries as text, one event per line
+* @param[in] triggers the names of the triggers (for the header)
+*/
+void write_summaries(std::ostream & out, const std::vector<event_summary> & summaries,
+    const std::vector<std::string> & triggers);
+
+}
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+/**
+* @file writer.h
+* @author C S Cowden
+* @brief Declare a streaming writer of graph collections.
+*/
+
+// --- includes ---
+#include <string>
+#include <fstream>
+
+#include "CaloGraphyIO.h"
+
+namespace cg {
+
+/**
+* @brief Streaming collection writer
+* @details Append event graphs to a file one at a time, so a graph can be
+* released as soon as it is written.  close() finalizes the file (the
+* event index of the binary format).
+* Encoding and appending are separate steps so that a writer shared by
+* several threads only needs to be locked while appending: each thread
+* encodes into its own buffer and appends the finished record.
+*/
+class collection_writer {
+public:
+
+  /**
+  * @brief default constructor
+  */
+  collection_writer():fmt_(binaryFormat),comp_(noCompression),offset_(0U) { }
+
+  /**
+  * @brief construct and open a file
+  */
+  collection_writer(const std::string & name, io_format fmt=binaryFormat, compression comp=noCompression,
+      const bin::vector_coding & coding=bin::vector_coding())
+    :fmt_(fmt),comp_(comp),offset_(0U)
+  { open(name,fmt,comp,coding); }
+
+  /**
+  * @brief destructor (closes the file)
+  */
+  ~collection_writer() { close(); }
+
+  // the writer is not copyable
+  collection_writer(const collection_writer &) = delete;
+  collection_writer & operator=(const collection_writer &) = delete;
+
+  /**
+  * @brief open a file, the binary header is written immediately.
+  * @param[in] comp compression of the events (binary format only)
+  * @param[in] coding coding of the 4-vectors (binary format only)
+  * @return false if the file can not be opened.
+  */
+  bool open(const std::string & name, io_format fmt=binaryFormat, compression comp=noCompression,
+      const bin::vector_coding & coding=bin::vector_coding());
+
+  /**
+  * @brief finalize and close the file
+  */
+  void close();
+
+  /**
+  * @brief check if a file is open
+  */
+  bool is_open() const { return out_.is_open(); }
+
+  /**
+  * @brief encode a graph as an event record in the given format.
+  * @param[in] nd the event graph
+  * @param[in] fmt the format
+  * @param[out] buf the buffer holding the record (cleared first)
+  * @param[in] comp the compression (binary format only)
+  * @param[in] coding the coding of the 4-vectors (binary format only)
+  * @return false if a position is out of the range of the coding or the
+  * compression fails (buf is then in the fail state and is not appended)
+  */
+  static bool encode(const node * nd, io_format fmt, bin::obuffer & buf, compression comp=noCompression,
+      const bin::vector_coding & coding=bin::vector_coding());
+
+  /**
+  * @brief append an event record made by encode() with the format,
+  * compression and coding of this file.
+  * @return the number of bytes written (0 for a record in the fail state).
+  */
+  size_t append(const bin::obuffer & buf);
+
+  /**
+  * @brief encode and append an event graph.
+  * @return the number of bytes written (0 if it could not be encoded).
+  */
+  size_t write(const node * nd);
+
+  /**
+  * @brief get the number of events written
+  */
+  size_t size() const { return index_.size(); }
+
+  /**
+  * @brief get the format of the file
+  */
+  io_format format() const { return fmt_; }
+
+  /**
+  * @brief get the compression of the events
+  */
+  compression compression_mode() const { return comp_; }
+
+  /**
+  * @brief get the coding of the 4-vectors
+  */
+  const bin::vector_coding & coding() const { return coding_; }
+
+private:
+
+  // the file
+  std::ofstream out_;
+  io_format fmt_;
+  compression comp_;
+  bin::vector_coding coding_;
+
+  // encoding buffer for write()
+  bin::obuffer buf_;
+
+  // event index (binary format)
+  bin::event_index index_;
+  uint64_t offset_;
+
+  // a flag for each name id written so far (binary format)
+  std::vector<bool> names_;
+
+};
+
+}
+
+#endif
@@ -3,6 +3,8 @@
 #include "CaloGraphyIO.h"
 
 #include <sstream>
+#include <fstream>
+#include <chrono>
 
 #include "G4Types.hh"
 #include "G4Step.hh"
@@ -12,10 +14,106 @@
 #include "G4VProcess.hh"
 
 
-namespace { G4Mutex cgMutex = G4MUTEX_INITIALIZER; }
+namespace {
 
+  G4Mutex cgMutex = G4MUTEX_INITIALIZER;
+
+  // nanoseconds since a time point
+  double elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double,std::nano>(std::chrono::steady_clock::now()-start).count();
+  }
+
+}
+
+
+cg::event_list cg::CGG4Interface::event_graphs_;
+std::vector<std::unique_ptr<cg::arena> > cg::CGG4Interface::event_arenas_;
+cg::collection_writer cg::CGG4Interface::sink_;
+unsigned cg::CGG4Interface::run_number_ = 0U;
+cg::build_stats cg::CGG4Interface::run_stats_;
+std::vector<cg::event_summary> cg::CGG4Interface::run_summaries_;
 
-cg::node_collection cg::CGG4Interface::event_graphs_  = cg::node_collection();
+
+// output file name
+std::string cg::CGG4Interface::file_name(unsigned run_number, const char * ext) const
+{
+  // append the run number to the base name
+  std::stringstream namestr;
+  namestr << base_name_ << run_number << ext;
+  return namestr.str();
+}
+
+
+// interned process name
+cg::name_id cg::CGG4Interface::process_name(const G4VProcess * proc)
+{
+  auto it = proc_names_.find(proc);
+  if ( it != proc_names_.end() )
+    return it->second;
+
+  const name_id id = process_names().intern(proc->GetProcessName());
+  proc_names_.emplace(proc,id);
+  return id;
+}
+
+
+// collect statistics
+void cg::CGG4Interface::set_stats(bool st)
+{
+  if ( !st )
+    stats_.reset();
+  else if ( !stats_ )
+    stats_.reset(new build_stats);
+  uncounted_ = false;
+}
+
+
+// write the statistics of the run
+bool cg::CGG4Interface::write_stats(const std::string & name)
+{
+  count_event();
+
+  build_stats all;
+  {
+    G4AutoLock l(&cgMutex);
+    all.merge(run_stats_);
+    run_stats_.clear();
+  }
+  if ( stats_ ) {
+    all.merge(*stats_);
+    stats_->clear();
+  }
+  return all.write_json(name);
+}
+
+
+// count the nodes of the current event
+void cg::CGG4Interface::count_event()
+{
+  if ( !stats_ || !uncounted_ )
+    return;
+  stats_->add_event(builder_.nodes());
+  uncounted_ = false;
+}
+
+
+// record the steps to a trace
+bool cg::CGG4Interface::set_trace(const std::string & name)
+{
+  if ( name.empty() ) {
+    trace_.close();
+    return true;
+  }
+  return trace_.open(name);
+}
+
+
+// start a run
+void cg::CGG4Interface::start_run(unsigned run_number)
+{
+  G4AutoLock l(&cgMutex);
+  run_number_ = run_number;
+}
 
 
 // write collection
@@ -24,10 +122,62 @@ void cg::CGG4Interface::write_collection(unsigned run_number)
 
   // if serial application, or is master thread write data
   if ( !G4Threading::IsMultithreadedApplication() || G4Threading::IsMasterThread() ) {
-    // append the run number to the base name
-    std::stringstream namestr;
-    namestr << base_name_ << run_number << ".cg";
-    cg::WriteCollection(event_graphs_,namestr.str());
+
+    // streaming, the events are already written, finalize the file
+    if ( streaming_ ) {
+      G4AutoLock l(&cgMutex);
+      if ( !sink_.is_open() )
+        sink_.open(file_name(run_number),format_,compression_,coding_);
+      sink_.close();
+    } else {
+
+      // the serial application keeps the graphs in the local collection
+      const node_collection & graphs = G4Threading::IsMultithreadedApplication() ? collection() : local_data_;
+      if ( !stats_ ) {
+        cg::WriteCollection(graphs,file_name(run_number),format_,compression_,coding_);
+      } else {
+        // one event at a time to record the bytes of each
+        const auto start = std::chrono::steady_clock::now();
+        cg::collection_writer out(file_name(run_number),format_,compression_,coding_);
+        uint64_t bytes = 0U;
+        for ( const cg::node * nd : graphs ) {
+          const size_t n = out.write(nd);
+          stats_->add_event_bytes(n);
+          bytes += n;
+        }
+        out.close();
+        stats_->add_write(elapsed_ns(start),bytes);
+      }
+
+      // pooled graphs are released once written, with their arenas
+      if ( pooled_ ) {
+        if ( G4Threading::IsMultithreadedApplication() ) {
+          G4AutoLock l(&cgMutex);
+          event_graphs_.clear();
+          event_arenas_.clear();
+          merged_.clear();
+        } else {
+          local_data_.clear();
+          arenas_.clear();
+        }
+      }
+    }
+
+    if ( stats_ )
+      write_stats(file_name(run_number,".stats.json"));
+
+    // the summaries of the run
+    std::vector<event_summary> all;
+    {
+      G4AutoLock l(&cgMutex);
+      all.swap(run_summaries_);
+    }
+    all.insert(all.end(),summaries_.begin(),summaries_.end());
+    summaries_.clear();
+    if ( selector_.active() || !all.empty() ) {
+      std::ofstream out(file_name(run_number,".summary.txt"));
+      cg::write_summaries(out,all,selector_.trigger_names());
+    }
   }
 
 }
@@ -38,12 +188,36 @@ void cg::CGG4Interface::merge()
 { 
 
   // if serial application - do nothing
-  // if workder thread, append to static data
+  // if workder thread, append to static data (one range, no lock)
   if ( G4Threading::IsWorkerThread() && G4Threading::IsMultithreadedApplication() ) {
+    const auto start = std::chrono::steady_clock::now();
+    event_graphs_.append(local_data_);
+    if ( stats_ ) {
+      stats_->add_merge(elapsed_ns(start));
+      count_event();
+    }
+
+    // the arenas, statistics and summaries of the thread join those of
+    // the run, under the lock only if there are any
+    const bool pooled = pooled_ && !streaming_;
+    if ( !pooled && !stats_ && summaries_.empty() )
+      return;
     G4AutoLock l(&cgMutex);
-    const unsigned ngraphs = local_data_.size();
-    for ( unsigned i=0; i != ngraphs; i++ )
-      event_graphs_.push_back(local_data_[i]);
+
+    // pooled graphs now belong to the shared list, as do their arenas
+    if ( pooled ) {
+      for ( auto & a : arenas_ )
+        event_arenas_.push_back(std::move(a));
+      arenas_.clear();
+      local_data_.clear();
+    }
+
+    if ( stats_ ) {
+      run_stats_.merge(*stats_);
+      stats_->clear();
+    }
+    run_summaries_.insert(run_summaries_.end(),summaries_.begin(),summaries_.end());
+    summaries_.clear();
   }
 
 }
@@ -54,99 +228,77 @@ void cg::CGG4Interface::merge()
 // process a step
 void cg::CGG4Interface::process_step(const G4Step * step)
 { 
+  // time the step (statistics only)
+  std::chrono::steady_clock::time_point start;
+  if ( stats_ )
+    start = std::chrono::steady_clock::now();
+
+  // allocate nodes from the event arena
+  cg::arena::scope pool(pooled_ && !arenas_.empty() ? arenas_.back().get() : NULL);
 
   //  get the track information
   auto track = step->GetTrack();
-  auto id = track->GetTrackID();
-  auto eDep = step->GetTotalEnergyDeposit();
-        
-
-  // get the end process of the step
+  step_.track_id = track->GetTrackID();
+  step_.pdg = track->GetParticleDefinition()->GetPDGEncoding();
+  step_.status = track->GetTrackStatus();
+  step_.edep = step->GetTotalEnergyDeposit();
+
+  // the pre-step point (used to start the root)
+  auto pret = step->GetPreStepPoint();
+  auto prepos3 = pret->GetPosition();
+  auto premom3 = pret->GetMomentum();
+  step_.pre_pos = cg::relvec(pret->GetGlobalTime(),prepos3.x(),prepos3.y(),prepos3.z());
+  step_.pre_mom = cg::relvec(pret->GetTotalEnergy(),premom3.x(),premom3.y(),premom3.z());
+
+  // the post-step point and the end process of the step
   auto post = step->GetPostStepPoint();
-  auto proc = post->GetProcessDefinedStep();
-  auto procname = proc->GetProcessName();
-
-  auto t = post->GetGlobalTime();
   auto pos3 = post->GetPosition();
-  cg::relvec pos(t,pos3.x(),pos3.y(),pos3.z());
-
-
-  // find the track in the graph
-  // keep a stack of tracks as well to quickly look this up
-  // if this is the first step in the event, start the root node.
-  cg::track * theNode;
-  if ( stack_.empty() && id == 1) {
-    const size_t nevents = local_data_.size();
-    auto pdgid = track->GetParticleDefinition()->GetPDGEncoding();
-    auto pret = step->GetPreStepPoint();
-    auto Etot = pret->GetTotalEnergy();
-    auto mom = pret->GetMomentum();
-
-    cg::relvec mom4(Etot,mom.x(),mom.y(),mom.z());
+  auto mom3 = post->GetMomentum();
+  step_.post_pos = cg::relvec(post->GetGlobalTime(),pos3.x(),pos3.y(),pos3.z());
+  step_.post_mom = cg::relvec(post->GetTotalEnergy(),mom3.x(),mom3.y(),mom3.z());
+  step_.process = process_name(post->GetProcessDefinedStep());
 
-    auto tpre = pret->GetGlobalTime();
-    auto prepos3 = pret->GetPosition();
-    cg::relvec prepos(tpre,prepos3.x(),prepos3.y(),prepos3.z());
-
-    // instantiate the root node 
-    theNode = new cg::track(pdgid,id,mom4,eDep,prepos);
-
-    // increment the track count
-    trck_cnt_++;
-
-    local_data_[nevents-1] = theNode;
-  } else {
-    theNode = stack_.top();
-    stack_.pop();
-  }
-
-  // check the track id
-  assert(theNode->G4TrackID() == id);
-
-  // update the energy lost in the step
-  theNode->set_energy(eDep);
-
-
-  //  attach the process
-  cg::process * procNode = new cg::process(procname,0.,pos);
-  theNode->add_child(procNode); 
-  
-
-  // process secondaries
+  // secondaries
   auto secondaries = step->GetSecondaryInCurrentStep();
   auto nsec = secondaries->size();
-  for ( unsigned i=0; i != nsec; i++ ){
-    // get secondary information
-    auto sectrk = (*secondaries)[i];
-    auto secid = ++trck_cnt_;
-    auto secpdg = sectrk->GetParticleDefinition()->GetPDGEncoding();
-
-    auto secpart = sectrk->GetDynamicParticle();
+  step_.secondaries.resize(nsec);
+  for ( unsigned i=0; i != nsec; i++ ) {
+    auto secpart = (*secondaries)[i]->GetDynamicParticle();
     auto secmom = secpart->GetMomentum();
-    auto secE = secpart->GetTotalEnergy();
-    cg::relvec mom(secE,secmom.x(),secmom.y(),secmom.z());
-
-    // create secondary track nodes
-    // put track node on stack
-    cg::track * subNode = new cg::track(secpdg,secid,mom,0.,pos);
-    procNode->add_child(subNode); 
-    stack_.push(subNode);
-
+    step_.secondaries[i].pdg = (*secondaries)[i]->GetParticleDefinition()->GetPDGEncoding();
+    step_.secondaries[i].mom = cg::relvec(secpart->GetTotalEnergy(),secmom.x(),secmom.y(),secmom.z());
   }
 
-  // if track status is alive, add track out of process and put on top of stack
-  if ( track->GetTrackStatus() == fAlive || track->GetTrackStatus() == fStopButAlive ) {
-    // get info
-    auto pdgid = track->GetParticleDefinition()->GetPDGEncoding();
+  if ( trace_.is_open() )
+    trace_.record(step_);
+
+  // the summary of the event, the graph is only built for prescaled events
+  if ( selector_.active() ) {
+    if ( summary_.steps++ == 0U ) {
+      summary_.primary_pdg = step_.pdg;
+      summary_.primary_energy = step_.pre_mom.t_;
+    }
+    summary_.edep += step_.edep;
+    summary_.secondaries += step_.secondaries.size();
+    summary_.tmax = std::max(summary_.tmax,step_.post_pos.t_);
+    if ( !selected_ )
+      return;
+  }
 
-    auto etot = post->GetTotalEnergy();
-    auto mom3 = post->GetMomentum();
-    cg::relvec mom(etot,mom3.x(),mom3.y(),mom3.z());
-    
-    cg::track * nxtstep = new cg::track(pdgid,id,mom,0.,pos); 
-    procNode->add_child(nxtstep);
+  // build the graph, the first step of the event starts the root which
+  // replaces the place holder of start_event
+  const uint64_t nodes = builder_.nodes();
+  builder_.process_step(step_);
+  cg::node * root = builder_.root();
+  if ( root && !local_data_.empty() && local_data_.back() != root ) {
+    delete local_data_.back();
+    local_data_.back() = root;
+  }
 
-    stack_.push(nxtstep);
+  if ( stats_ ) {
+    stats_->add_step(step_.process,step_.pdg,builder_.nodes()-nodes,step_.edep,
+        elapsed_ns(start),builder_.stack_size());
+    uncounted_ = true;
   }
 
 }
@@ -157,13 +309,92 @@ void cg::CGG4Interface::process_step(const G4Step * step)
 // start a new event
 void cg::CGG4Interface::start_event()
 { 
+  // a new arena for each event, streaming reuses one
+  if ( pooled_ && ( !streaming_ || arenas_.empty() ) )
+    arenas_.push_back(std::unique_ptr<cg::arena>(new cg::arena));
+  cg::arena::scope pool(pooled_ ? arenas_.back().get() : NULL);
+
   // 
   cg::node *nd = new cg::node;
   local_data_.push_back(nd);
 
-  // clear the stack
-  stack_ = std::stack<cg::track *>(); 
-  trck_cnt_ = 0U;
+  // clear the track stack
+  count_event();
+  builder_.start_event();
+  if ( trace_.is_open() )
+    trace_.start_event();
+
+  // start the summary, is the graph built
+  summary_ = event_summary{events_,G4Threading::G4GetThreadId(),0,0.,0.,0U,0U,0U,0.,0U,false};
+  selected_ = selector_.prescaled(events_++);
+  open_ = true;
+}
+
+
+// end an event
+void cg::CGG4Interface::end_event()
+{
+  if ( trace_.is_open() )
+    trace_.end_event();
+  count_event();
+  if ( open_ && selector_.active() )
+    select_event();
+  open_ = false;
+  if ( !streaming_ || local_data_.empty() )
+    return;
+
+  // encode the graph outside of the lock
+  const auto start = std::chrono::steady_clock::now();
+  cg::node * nd = local_data_.back();
+  cg::collection_writer::encode(nd,format_,record_,compression_,coding_);
+
+  size_t bytes;
+  {
+    G4AutoLock l(&cgMutex);
+    if ( !sink_.is_open() )
+      sink_.open(file_name(run_number_),format_,compression_,coding_);
+    bytes = sink_.append(record_);
+  }
+  if ( stats_ ) {
+    stats_->add_event_bytes(bytes);
+    stats_->add_write(elapsed_ns(start),bytes);
+  }
+
+  // release the graph
+  if ( pooled_ && !arenas_.empty() )
+    arenas_.back()->reset();
+  else
+    delete nd;
+  local_data_.clear();
+  builder_.start_event();
+}
+
+
+
+// select the current event
+void cg::CGG4Interface::select_event()
+{
+  cg::node * root = builder_.root();
+  summary_.nodes = builder_.nodes();
+  if ( selected_ && root )
+    summary_.triggers = selector_.evaluate(*root,summary_);
+  summary_.recorded = selected_ && root && selector_.accept(summary_.triggers);
+  summaries_.push_back(summary_);
+  if ( summary_.recorded || local_data_.empty() )
+    return;
+
+  // discard the graph (or the place holder of start_event)
+  cg::node * nd = local_data_.back();
+  local_data_.pop_back();
+  if ( pooled_ && !arenas_.empty() ) {
+    if ( streaming_ )
+      arenas_.back()->reset();
+    else
+      arenas_.pop_back();
+  } else {
+    delete nd;
+  }
+  builder_.start_event();
 }
 
 
@@ -177,7 +408,6 @@ size_t cg::CGG4Interface::size() const
     return local_data_.size();
   } else if ( G4Threading::IsMasterThread() ) {
     // if master thread, return static collection size.
-    G4AutoLock l(&cgMutex);
     return event_graphs_.size();
   } else {
     return 0;
@@ -196,9 +426,9 @@ cg::node_collection & cg::CGG4Interface::collection()
   if ( !G4Threading::IsMultithreadedApplication() || G4Threading::IsWorkerThread() ) {
     return local_data_;
   } else if ( G4Threading::IsMasterThread() ) {
-    // if master thread, return static collection.
-    G4AutoLock l(&cgMutex);
-    return event_graphs_;
+    // if master thread, return a copy of the static collection.
+    event_graphs_.copy(merged_);
+    return merged_;
   } else {
     return local_data_;
   }
@@ -216,7 +446,6 @@ cg::node * cg::CGG4Interface::get_node(const unsigned i)
     else assert(false);  // throw assertion error if i is out of range
   } else {
     // if master thread, return node from static data
-    G4AutoLock l(&cgMutex);
     if ( i < event_graphs_.size() ) return event_graphs_[i];
     else assert(false);  // throw assertion error if i is out of range
   } 
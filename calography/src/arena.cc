@@ -0,0 +1,126 @@
+
+
+#include "arena.h"
+
+#include <new>
+#include <cstdint>
+
+
+namespace { thread_local cg::arena * currentArena = NULL; }
+
+
+// constructor
+cg::arena::arena(size_t block_size)
+  :head_(NULL)
+  ,cur_(NULL)
+  ,end_(NULL)
+  ,block_size_(block_size)
+  ,used_(0U)
+  ,capacity_(0U)
+{ }
+
+// destructor
+cg::arena::~arena() {
+  release();
+}
+
+// allocate
+void * cg::arena::do_allocate(size_t bytes, size_t alignment) {
+  uintptr_t p = (reinterpret_cast<uintptr_t>(cur_)+alignment-1) & ~uintptr_t(alignment-1);
+  if ( !cur_ || p+bytes > reinterpret_cast<uintptr_t>(end_) ) {
+    grow(bytes,alignment);
+    p = (reinterpret_cast<uintptr_t>(cur_)+alignment-1) & ~uintptr_t(alignment-1);
+  }
+  cur_ = reinterpret_cast<char *>(p+bytes);
+  used_ += bytes;
+  return reinterpret_cast<void *>(p);
+}
+
+// add a block
+void cg::arena::grow(size_t bytes, size_t alignment) {
+  size_t size = block_size_;
+  if ( size < bytes+alignment+sizeof(block) )
+    size = bytes+alignment+sizeof(block);
+
+  block * blk = static_cast<block *>(::operator new(size));
+  blk->next = head_;
+  blk->size = size;
+  head_ = blk;
+  capacity_ += size;
+
+  cur_ = reinterpret_cast<char *>(blk+1);
+  end_ = reinterpret_cast<char *>(blk)+size;
+}
+
+// reset, keep the largest block
+void cg::arena::reset() {
+  block * keep = NULL;
+  for ( block * blk = head_; blk; ) {
+    block * next = blk->next;
+    if ( !keep || blk->size > keep->size ) {
+      if ( keep )
+        ::operator delete(keep);
+      keep = blk;
+    } else
+      ::operator delete(blk);
+    blk = next;
+  }
+
+  head_ = keep;
+  used_ = 0U;
+  if ( keep ) {
+    keep->next = NULL;
+    capacity_ = keep->size;
+    cur_ = reinterpret_cast<char *>(keep+1);
+    end_ = reinterpret_cast<char *>(keep)+keep->size;
+  } else {
+    capacity_ = 0U;
+    cur_ = end_ = NULL;
+  }
+}
+
+// free all blocks
+void cg::arena::release() {
+  while ( head_ ) {
+    block * next = head_->next;
+    ::operator delete(head_);
+    head_ = next;
+  }
+  cur_ = end_ = NULL;
+  used_ = 0U;
+  capacity_ = 0U;
+}
+
+// current arena
+cg::arena * cg::arena::current() {
+  return currentArena;
+}
+
+// current memory resource
+std::pmr::memory_resource * cg::arena::resource() {
+  if ( currentArena )
+    return currentArena;
+  return std::pmr::get_default_resource();
+}
+
+// make an arena current
+cg::arena::scope::scope(arena & a)
+  :prev_(currentArena)
+{
+  currentArena = &a;
+}
+
+// make an arena current (if given)
+cg::arena::scope::scope(arena * a)
+  :prev_(currentArena)
+{
+  if ( a )
+    currentArena = a;
+}
+
+// restore the previous arena
+cg::arena::scope::~scope() {
+  currentArena = prev_;
+}
+
+
@@ -0,0 +1,46 @@
+
+
+#include "binio.h"
+
+#include <zlib.h>
+
+
+// compress an event payload
+bool cg::bin::compress(const char * data, size_t n, int level, obuffer & out) {
+  out.clear();
+  out.put<uint8_t>(zlibCodec);
+  out.put<uint64_t>(n);
+
+  uLongf len = compressBound(n);
+  out.resize(compressed_header_size+len);
+  if ( compress2(reinterpret_cast<Bytef *>(out.data()+compressed_header_size),&len,
+        reinterpret_cast<const Bytef *>(data),n,level) != Z_OK ) {
+    out.clear();
+    return false;
+  }
+  out.resize(compressed_header_size+len);
+  return true;
+}
+
+// decompress an event payload
+bool cg::bin::decompress(const char * data, size_t n, std::vector<char> & out) {
+  if ( n < compressed_header_size || uint8_t(data[0]) != zlibCodec )
+    return false;
+
+  uint64_t size;
+  std::memcpy(&size,data+1,sizeof(size));
+  if ( size > (n-compressed_header_size)*max_deflate_ratio ) {
+    out.clear();
+    return false;
+  }
+  out.resize(size);
+  uLongf len = size;
+  if ( uncompress(reinterpret_cast<Bytef *>(out.data()),&len,
+        reinterpret_cast<const Bytef *>(data+compressed_header_size),n-compressed_header_size) != Z_OK
+      || len != size ) {
+    out.clear();
+    return false;
+  }
+  return true;
+}
+
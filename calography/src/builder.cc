@@ -0,0 +1,139 @@
+
+
+#include "builder.h"
+
+#include <cassert>
+
+
+// constructor
+cg::graph_builder::graph_builder()
+  :trck_cnt_(0U)
+  ,root_(NULL)
+  ,nodes_(0U)
+  ,trajectories_(false)
+  ,indexed_(false)
+{ }
+
+
+// create a track node
+cg::track * cg::graph_builder::new_track(int pdg, unsigned g4id, const relvec & mom, const relvec & pos)
+{
+  nodes_++;
+  if ( trajectories_ )
+    return new cg::trajectory(pdg,g4id,mom,0.,pos);
+  return new cg::track(pdg,g4id,mom,0.,pos);
+}
+
+
+// start a new event
+void cg::graph_builder::start_event()
+{
+  stack_ = std::stack<stack_entry>();
+  trck_cnt_ = 0U;
+  root_ = NULL;
+  nodes_ = 0U;
+}
+
+
+// process a step
+void cg::graph_builder::process_step(const step_record & st)
+{
+  const int id = st.track_id;
+  const double eDep = st.edep;
+  const name_id procname = st.process;
+  const relvec & pos = st.post_pos;
+  const double t = pos.t_;
+
+  // find the track in the graph
+  // keep a stack of tracks as well to quickly look this up
+  // if this is the first step in the event, start the root node.
+  stack_entry entry;
+  if ( stack_.empty() && id == 1) {
+
+    // instantiate the root node
+    root_ = new_track(st.pdg,id,st.pre_mom,st.pre_pos);
+    entry = stack_entry{root_,unsigned(id),0U,true,0.};
+
+    // nodes added below an indexed root join its index
+    if ( indexed_ )
+      root_->build_index();
+
+    // increment the track count
+    trck_cnt_++;
+  } else {
+    entry = stack_.top();
+    stack_.pop();
+  }
+
+  // check the track id
+  assert(entry.g4id == unsigned(id));
+
+  // add the energy lost in the step, summed in double precision for the
+  // node (or added to the recorded track above if the track is not recorded)
+  cg::track * theNode = entry.node;
+  if ( entry.recorded ) {
+    entry.edep += eDep;
+    theNode->set_energy(entry.edep);
+  } else {
+    theNode->set_energy(theNode->energy()+eDep);
+  }
+
+  // may the step record its process and secondaries
+  const bool accepted = entry.recorded && policy_.accept_process(procname,t);
+  const bool deposit = accepted && policy_.accept_deposit(eDep);
+
+  //  attach the process (trajectories keep the step as a step point)
+  cg::process * procNode = NULL;
+  if ( deposit && trajectories_ ) {
+    static_cast<cg::trajectory *>(theNode)->add_step(pos,eDep,procname);
+  } else if ( deposit ) {
+    procNode = new cg::process(procname,0.,pos);
+    theNode->add_child(procNode);
+    nodes_++;
+  }
+
+
+  // process secondaries
+  for ( const step_secondary & sec : st.secondaries ) {
+    auto secid = ++trck_cnt_;
+
+    // secondaries which are not recorded keep a place on the stack
+    if ( !accepted || !policy_.accept_track(sec.pdg,sec.mom.t_,entry.depth+1U) ) {
+      stack_.push(stack_entry{theNode,secid,entry.depth+1U,false,0.});
+      continue;
+    }
+
+    // a recorded secondary needs the process
+    if ( !procNode ) {
+      procNode = new cg::process(procname,0.,pos);
+      theNode->add_child(procNode);
+      nodes_++;
+    }
+
+    // create secondary track nodes
+    // put track node on stack
+    cg::track * subNode = new_track(sec.pdg,secid,sec.mom,pos);
+    procNode->add_child(subNode);
+    stack_.push(stack_entry{subNode,secid,entry.depth+1U,true,0.});
+
+  }
+
+  // if track status is alive, add track out of process and put on top of stack
+  if ( st.alive() ) {
+
+    // the track continues in the same node if the step is not recorded
+    // (or is a step point of a trajectory)
+    if ( !procNode || trajectories_ ) {
+      stack_.push(entry);
+      return;
+    }
+
+    cg::track * nxtstep = new cg::track(st.pdg,id,st.post_mom,0.,pos);
+    procNode->add_child(nxtstep);
+    nodes_++;
+
+    stack_.push(stack_entry{nxtstep,unsigned(id),entry.depth,true,0.});
+  }
+
+}
+
@@ -0,0 +1,183 @@
+
+
+#include "compact.h"
+
+#include <utility>
+
+#include "node.h"
+#include "track.h"
+#include "process.h"
+#include "mapped.h"
+
+
+// clear
+void cg::compact_graph::clear() {
+  id_.clear();
+  type_.clear();
+  energy_.clear();
+  etot_.clear();
+  t_.clear(); x_.clear(); y_.clear(); z_.clear();
+  pdg_.clear();
+  g4trackid_.clear();
+  proc_.clear();
+  parent_.clear();
+  depth_.clear();
+  end_.clear();
+  child_offsets_.clear();
+  child_index_.clear();
+  names_.clear();
+}
+
+// append a node
+void cg::compact_graph::push(node_id id, node_type type, float E, const relvec & pos,
+    int pdg, unsigned g4trackid, double etot, int32_t proc) {
+  id_.push_back(id);
+  type_.push_back(type);
+  energy_.push_back(E);
+  etot_.push_back(etot);
+  t_.push_back(pos.t_);
+  x_.push_back(pos.x_);
+  y_.push_back(pos.y_);
+  z_.push_back(pos.z_);
+  pdg_.push_back(pdg);
+  g4trackid_.push_back(g4trackid);
+  proc_.push_back(proc);
+}
+
+// index of a process name
+int32_t cg::compact_graph::intern(node_type type, std::string_view name) {
+  if ( type != processNode )
+    return -1;
+  int32_t proc = process_index(name);
+  if ( proc < 0 ) {
+    proc = names_.size();
+    names_.push_back(std::string(name));
+  }
+  return proc;
+}
+
+// build from a node tree
+void cg::compact_graph::build(const node * root) {
+  clear();
+  if ( !root )
+    return;
+
+  // the local index of each interned name
+  std::vector<int32_t> local;
+
+  // depth-first with an explicit stack of (node, parent index)
+  std::vector<std::pair<const node *,int32_t> > stack(1,std::make_pair(root,-1));
+  while ( !stack.empty() ) {
+    const node * nd = stack.back().first;
+    const int32_t parent = stack.back().second;
+    stack.pop_back();
+
+    const index i = size();
+    const node_type type = nd->type();
+    int pdg = 0;
+    unsigned g4id = 0U;
+    double etot = 0.;
+    int32_t proc = -1;
+    if ( track::is_track(type) ) {
+      pdg = static_cast<const track *>(nd)->pdg();
+      g4id = static_cast<const track *>(nd)->G4TrackID();
+      etot = static_cast<const track *>(nd)->momentum().t_;
+    } else if ( type == processNode ) {
+      const name_id nm = static_cast<const process *>(nd)->name_index();
+      if ( nm >= local.size() )
+        local.resize(nm+1U,-1);
+      if ( local[nm] < 0 ) {
+        local[nm] = names_.size();
+        names_.push_back(std::string(process_names().name(nm)));
+      }
+      proc = local[nm];
+    }
+    push(nd->id(),type,nd->energy(),nd->pos(),pdg,g4id,etot,proc);
+    parent_.push_back(parent);
+    depth_.push_back(parent < 0 ? 0U : depth_[parent]+1U);
+
+    // push the children in reverse to visit them in order
+    const node_list & kids = nd->children();
+    for ( size_t k=kids.size(); k != 0; k-- )
+      stack.push_back(std::make_pair(kids[k-1],int32_t(i)));
+  }
+
+  finish();
+}
+
+// build from a mapped record
+void cg::compact_graph::build(const node_view & root) {
+  clear();
+  if ( !root.valid() )
+    return;
+
+  // the last node seen at each depth is the parent of the next deeper node
+  std::vector<int32_t> last;
+  subgraph_range nodes = root.subgraph();
+  for ( subgraph_range::iterator it = nodes.begin(); it != nodes.end(); ++it ) {
+    const index i = size();
+    const unsigned d = it.depth();
+    last.resize(d+1);
+    last[d] = i;
+
+    push(it->id(),it->type(),it->energy(),it->pos(),it->pdg(),it->G4TrackID(),it->momentum().t_,
+      intern(it->type(),it->name()));
+    parent_.push_back(d ? last[d-1] : -1);
+    depth_.push_back(d);
+  }
+
+  finish();
+}
+
+// compute the structure columns
+void cg::compact_graph::finish() {
+  const index n = size();
+
+  // sub-graph sizes accumulate from the leaves up
+  end_.assign(n,1U);
+  for ( index i=n; i-- > 1; )
+    end_[parent_[i]] += end_[i];
+  for ( index i=0; i != n; i++ )
+    end_[i] += i;
+
+  // child lists, children appear in increasing index order
+  child_offsets_.assign(n+1,0U);
+  for ( index i=1; i < n; i++ )
+    child_offsets_[parent_[i]+1]++;
+  for ( index i=0; i != n; i++ )
+    child_offsets_[i+1] += child_offsets_[i];
+
+  child_index_.resize(n ? n-1 : 0);
+  std::vector<uint32_t> fill(child_offsets_.begin(),child_offsets_.end()-1);
+  for ( index i=1; i < n; i++ )
+    child_index_[fill[parent_[i]]++] = i;
+}
+
+// total energy of a sub-graph
+double cg::compact_graph::totalenergy(index i) const {
+  double sum = 0.;
+  const float * e = energy_.data();
+  const index last = end_[i];
+  for ( index j=i; j < last; j++ )
+    sum += e[j];
+  return sum;
+}
+
+// find a node
+int64_t cg::compact_graph::find(node_id id) const {
+  const index n = size();
+  for ( index i=0; i != n; i++ )
+    if ( id_[i] == id )
+      return i;
+  return -1;
+}
+
+// look up a process name
+int32_t cg::compact_graph::process_index(std::string_view name) const {
+  for ( size_t i=0; i != names_.size(); i++ )
+    if ( names_[i] == name )
+      return i;
+  return -1;
+}
+
+
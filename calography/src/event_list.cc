@@ -0,0 +1,147 @@
+
+
+#include "event_list.h"
+
+#include <algorithm>
+#include <cassert>
+
+
+// constructor
+cg::event_list::event_list()
+  :reserved_(0U)
+  ,published_(0U)
+{
+  for ( unsigned k=0; k != maxSegments; k++ )
+    segments_[k].store(NULL,std::memory_order_relaxed);
+}
+
+// destructor
+cg::event_list::~event_list() {
+  clear();
+}
+
+// find a slot
+void cg::event_list::locate(size_t i, unsigned & seg, size_t & offset) {
+
+  // segment k starts at slot segmentSize*(2^k-1)
+  size_t first = 0U;
+  size_t n = segmentSize;
+  seg = 0U;
+  while ( i >= first+n ) {
+    first += n;
+    n *= 2U;
+    seg++;
+  }
+  offset = i-first;
+}
+
+// get a segment
+cg::event_list::slot * cg::event_list::segment(unsigned seg) {
+  assert(seg < maxSegments);
+
+  slot * slots = segments_[seg].load(std::memory_order_acquire);
+  if ( slots )
+    return slots;
+
+  // allocate, the first thread to install its segment wins
+  const size_t n = segmentSize << seg;
+  slot * fresh = new slot[n];
+  for ( size_t i=0; i != n; i++ )
+    fresh[i].ready.store(false,std::memory_order_relaxed);
+  if ( segments_[seg].compare_exchange_strong(slots,fresh,std::memory_order_acq_rel) )
+    return fresh;
+  delete [] fresh;
+  return slots;
+}
+
+// check a slot
+bool cg::event_list::ready(size_t i) const {
+  unsigned seg;
+  size_t offset;
+  locate(i,seg,offset);
+  if ( seg >= maxSegments )
+    return false;
+  const slot * slots = segments_[seg].load(std::memory_order_acquire);
+  return slots && slots[offset].ready.load(std::memory_order_seq_cst);
+}
+
+// publish the ready slots
+void cg::event_list::publish() {
+
+  // the slots are marked and checked in one total order, so of two
+  // appenders finishing at once at least one sees the slots of the other
+  size_t end = published_.load(std::memory_order_seq_cst);
+  for ( ;; ) {
+    size_t next = end;
+    while ( ready(next) )
+      next++;
+    if ( next == end )
+      return;
+    // on failure end is the size published by another thread
+    if ( published_.compare_exchange_weak(end,next,std::memory_order_seq_cst) )
+      end = next;
+  }
+}
+
+// append graphs
+void cg::event_list::append(node * const * nds, size_t n) {
+  if ( n == 0U )
+    return;
+
+  // reserve the slots
+  const size_t start = reserved_.fetch_add(n,std::memory_order_relaxed);
+
+  // fill them
+  unsigned seg;
+  size_t offset;
+  locate(start,seg,offset);
+  slot * slots = segment(seg);
+  for ( size_t i=0; i != n; i++ ) {
+    if ( offset == (segmentSize << seg) ) {
+      slots = segment(++seg);
+      offset = 0U;
+    }
+    slots[offset].nd = nds[i];
+    slots[offset++].ready.store(true,std::memory_order_seq_cst);
+  }
+
+  // publish them, and the ranges of later appenders which are ready; if
+  // an earlier range is being filled, its appender publishes this one
+  publish();
+}
+
+// get a graph
+cg::node * cg::event_list::operator[](size_t i) const {
+  assert(i < size());
+  unsigned seg;
+  size_t offset;
+  locate(i,seg,offset);
+  return segments_[seg].load(std::memory_order_acquire)[offset].nd;
+}
+
+// copy the graphs
+void cg::event_list::copy(std::vector<node *> & nds) const {
+  const size_t n = size();
+  nds.clear();
+  nds.reserve(n);
+
+  // one segment at a time
+  size_t len = segmentSize;
+  for ( unsigned seg=0; nds.size() != n; seg++, len *= 2U ) {
+    const slot * slots = segments_[seg].load(std::memory_order_acquire);
+    const size_t m = std::min(len,n-nds.size());
+    for ( size_t i=0; i != m; i++ )
+      nds.push_back(slots[i].nd);
+  }
+}
+
+// remove all graphs
+void cg::event_list::clear() {
+  for ( unsigned k=0; k != maxSegments; k++ ) {
+    delete [] segments_[k].load(std::memory_order_relaxed);
+    segments_[k].store(NULL,std::memory_order_relaxed);
+  }
+  reserved_.store(0U,std::memory_order_relaxed);
+  published_.store(0U,std::memory_order_release);
+}
+
@@ -0,0 +1,91 @@
+
+
+#include "index.h"
+
+#include "node.h"
+#include "track.h"
+
+
+// constructor
+cg::node_index::node_index(node * root, std::pmr::memory_resource * res)
+  :root_(root)
+  ,ids_(res)
+  ,tracks_(res)
+{ }
+
+// add a sub-graph
+void cg::node_index::insert(node * nd) {
+
+  // a new leaf (the common case while a graph grows)
+  if ( nd->children_.empty() ) {
+    node_index * owned = nd->index_ != this && nd->index_ && nd->index_->root_ == nd ? nd->index_ : NULL;
+    add(nd);
+    release(owned);
+    return;
+  }
+
+  // collect the nodes in depth-first order (children pushed in reverse),
+  // then size the table once
+  std::vector<node *> nodes;
+  std::vector<node *> stack(1U,nd);
+  while ( !stack.empty() ) {
+    node * n = stack.back();
+    stack.pop_back();
+    stack.insert(stack.end(),n->children_.rbegin(),n->children_.rend());
+    nodes.push_back(n);
+  }
+
+  // the indexes owned by the inserted nodes are replaced by this one
+  std::vector<node_index *> owned;
+  for ( node * n : nodes ) {
+    if ( n->index_ != this && n->index_ && n->index_->root_ == n )
+      owned.push_back(n->index_);
+  }
+
+  ids_.reserve(ids_.size()+nodes.size());
+  for ( node * n : nodes )
+    add(n);
+  for ( node_index * idx : owned )
+    release(idx);
+}
+
+// add a node
+void cg::node_index::add(node * nd) {
+  nd->index_ = this;
+  ids_.emplace(nd->id(),nd);
+  if ( track::is_track(nd->type()) )
+    tracks_[static_cast<track *>(nd)->G4TrackID()].push_back(static_cast<track *>(nd));
+}
+
+// destroy an index whose nodes were moved to another
+void cg::node_index::release(node_index * idx) {
+  if ( !idx )
+    return;
+  std::pmr::memory_resource * res = idx->ids_.get_allocator().resource();
+  idx->~node_index();
+  std::pmr::polymorphic_allocator<node_index>(res).deallocate(idx,1U);
+}
+
+// remove all nodes
+void cg::node_index::clear() {
+
+  // walk the graph, the nodes of repeated ids are not in the table
+  std::vector<node *> stack(1U,root_);
+  while ( !stack.empty() ) {
+    node * n = stack.back();
+    stack.pop_back();
+    if ( n->index_ == this )
+      n->index_ = NULL;
+    stack.insert(stack.end(),n->children_.begin(),n->children_.end());
+  }
+  ids_.clear();
+  tracks_.clear();
+}
+
+// track nodes of a Geant4 track
+const cg::track_list & cg::node_index::tracks(unsigned g4id) const {
+  static const track_list none;
+  auto it = tracks_.find(g4id);
+  return it != tracks_.end() ? it->second : none;
+}
+
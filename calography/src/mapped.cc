@@ -0,0 +1,518 @@
+
+
+#include "mapped.h"
+
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <limits>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "CaloGraphyIO.h"
+
+
+// size of the sub-graph (clamped to the end of the event, the lengths
+// of a damaged file are not trusted)
+size_t cg::node_view::subgraph_size() const {
+  const size_t avail = end_-rec_;
+
+  // the length of the child records is stored since version 5
+  const unsigned tail = layout_->tailsize;
+  const uint64_t head = 5U+uint64_t(field_length())+tail;
+  if ( tail == 8U && head <= avail ) {
+    const uint32_t len = load<uint32_t>(fields()+field_length()+4);
+    if ( len != bin::unknownLength )
+      return std::min<uint64_t>(head+len,avail);
+  }
+
+  // walk the records, counting the nodes still to be skipped
+  size_t pos = 0U;
+  uint64_t pending = 1U;
+  while ( pending && pos+5U <= avail ) {
+    const uint64_t len = load<uint32_t>(rec_+pos+1);
+    if ( len+tail > avail-pos-5U )
+      return avail;
+    const uint32_t nkids = load<uint32_t>(rec_+pos+5+len);
+    pos += 5U+len+tail;
+    pending += nkids;
+    pending--;
+  }
+
+  return pos;
+}
+
+// extract the node objects
+cg::node * cg::node_view::extract() const {
+  bin::ibuffer buf(rec_,end_-rec_,layout_->version);
+  if ( layout_->version >= 3U )
+    buf.set_names(&layout_->ids);
+  buf.set_coding(layout_->coding);
+  buf.set_origin(origin_);
+  return cg::extract_node(buf);
+}
+
+
+// extract the node object of this node
+cg::node * cg::node_view::extract_node() const {
+  node * nd = new_node(type());
+  if ( !nd )
+    return NULL;
+
+  bin::ibuffer buf(fields(),field_length(),layout_->version);
+  if ( layout_->version >= 3U )
+    buf.set_names(&layout_->ids);
+  buf.set_coding(layout_->coding);
+  buf.set_origin(origin_);
+  nd->read_fields(buf);
+  return nd;
+}
+
+
+namespace {
+
+  typedef std::unordered_map<const cg::node *,cg::node_view> pending_map;
+
+  // build the nodes below a view down to a depth, skipping the sub-graphs
+  // rejected by a predicate; nodes at the depth with children are pending
+  void grow(cg::node * top, const cg::node_view & nv, unsigned maxDepth,
+      const cg::view_predicate * keep, pending_map * pending) {
+
+    struct frame {
+      cg::node * nd;
+      cg::child_range::iterator it;
+      unsigned depth;
+    };
+
+    const cg::child_range::iterator last;
+    std::vector<frame> stack;
+    if ( maxDepth == 0U ) {
+      if ( pending && nv.nchildren() )
+        pending->emplace(top,nv);
+      return;
+    }
+    stack.push_back(frame{top,nv.children().begin(),0U});
+
+    while ( !stack.empty() ) {
+      frame & f = stack.back();
+      if ( f.it == last ) {
+        stack.pop_back();
+        continue;
+      }
+      const cg::node_view child = *f.it;
+      ++f.it;
+
+      const unsigned depth = f.depth+1U;
+      if ( keep && !(*keep)(child,depth) )
+        continue;
+      cg::node * nd = child.extract_node();
+      if ( !nd )
+        continue;
+      f.nd->add_child(nd);
+
+      if ( depth < maxDepth )
+        stack.push_back(frame{nd,child.children().begin(),depth});
+      else if ( pending && child.nchildren() )
+        pending->emplace(nd,child);
+    }
+  }
+
+}
+
+// extract down to a depth
+cg::node * cg::node_view::extract(unsigned maxDepth) const {
+  node * nd = extract_node();
+  if ( nd )
+    grow(nd,*this,maxDepth,NULL,NULL);
+  return nd;
+}
+
+// extract the nodes selected by a predicate
+cg::node * cg::node_view::extract_if(const view_predicate & keep) const {
+  node * nd = extract_node();
+  if ( nd )
+    grow(nd,*this,std::numeric_limits<unsigned>::max(),&keep,NULL);
+  return nd;
+}
+
+// extract with sibling sub-graphs decoded concurrently
+cg::node * cg::node_view::extract_parallel(unsigned nthreads) const {
+
+  if ( nthreads == 0U )
+    nthreads = std::max(1U,std::thread::hardware_concurrency());
+
+  // sub-graphs up to a share of the whole are decoded as one task
+  const size_t share = subgraph_size()/(8U*nthreads);
+  if ( nthreads == 1U )
+    return extract();
+
+  // walk the large sub-graphs, calling split(view) for the nodes built here
+  // and task(view) for the sub-graphs decoded by the threads, in file order
+  auto walk = [this,share](auto && split, auto && task, auto && up) {
+    const child_range::iterator last;
+    std::vector<child_range::iterator> stack;
+    split(*this);
+    stack.push_back(children().begin());
+    while ( !stack.empty() ) {
+      if ( stack.back() == last ) {
+        stack.pop_back();
+        up();
+        continue;
+      }
+      const node_view child = *stack.back();
+      ++stack.back();
+      if ( child.subgraph_size() <= share ) {
+        task(child);
+      } else {
+        split(child);
+        stack.push_back(child.children().begin());
+      }
+    }
+  };
+
+  std::vector<node_view> tasks;
+  walk([](const node_view &) { },[&tasks](const node_view & nv) { tasks.push_back(nv); },[]() { });
+
+  // decode the tasks, the largest first
+  std::vector<size_t> order(tasks.size());
+  std::vector<size_t> sizes(tasks.size());
+  size_t tasked = 0U;
+  for ( size_t i=0; i != tasks.size(); i++ ) {
+    order[i] = i;
+    sizes[i] = tasks[i].subgraph_size();
+    tasked += sizes[i];
+  }
+
+  // long chains of large sub-graphs do not split, decode them serially
+  if ( tasks.size() < 2U || 2U*tasked < subgraph_size() )
+    return extract();
+  std::sort(order.begin(),order.end(),[&sizes](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+
+  std::vector<node *> graphs(tasks.size(),NULL);
+  std::atomic<size_t> next(0U);
+  auto work = [&]() {
+    size_t i;
+    while ( (i = next.fetch_add(1U,std::memory_order_relaxed)) < order.size() )
+      graphs[order[i]] = tasks[order[i]].extract();
+  };
+  std::vector<std::thread> threads;
+  for ( unsigned k=1; k < nthreads && k < tasks.size(); k++ )
+    threads.emplace_back(work);
+  work();
+  for ( std::thread & thr : threads )
+    thr.join();
+
+  // build the large sub-graphs and attach the decoded ones
+  node * root = NULL;
+  std::vector<node *> parents;
+  size_t k = 0U;
+  walk([&](const node_view & nv) {
+      node * nd = nv.extract_node();
+      if ( parents.empty() )
+        root = nd;
+      else if ( parents.back() && nd )
+        parents.back()->add_child(nd);
+      parents.push_back(nd);
+    },[&](const node_view &) {
+      node * nd = graphs[k++];
+      if ( parents.back() && nd )
+        parents.back()->add_child(nd);
+      else
+        delete nd;
+    },[&]() { parents.pop_back(); });
+
+  return root;
+}
+
+
+// build a lazy graph
+cg::lazy_graph::lazy_graph(const node_view & root, unsigned depth)
+  :root_(root.extract_node())
+{
+  if ( root_ )
+    grow(root_,root,depth,NULL,&pending_);
+}
+
+// delete the graph
+cg::lazy_graph::~lazy_graph() {
+  delete root_;
+}
+
+// expand a node
+void cg::lazy_graph::expand(node * nd, unsigned depth) {
+  auto it = pending_.find(nd);
+  if ( it == pending_.end() || depth == 0U )
+    return;
+  const node_view nv = it->second;
+  pending_.erase(it);
+  grow(nd,nv,depth,NULL,&pending_);
+}
+
+// release the graph
+cg::node * cg::lazy_graph::release() {
+  node * nd = root_;
+  root_ = NULL;
+  pending_.clear();
+  return nd;
+}
+
+
+// current layout
+const cg::record_layout * cg::record_layout::current() {
+  static const record_layout layout;
+  return &layout;
+}
+
+
+// map a file
+bool cg::mapped_collection::open(const std::string & name) {
+
+  close();
+
+  int fd = ::open(name.c_str(),O_RDONLY);
+  if ( fd < 0 ) {
+    std::cerr << "cg: can not open " << name << std::endl;
+    return false;
+  }
+
+  struct stat st;
+  if ( fstat(fd,&st) != 0 || size_t(st.st_size) < bin::header_size ) {
+    ::close(fd);
+    return false;
+  }
+
+  void * addr = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+  ::close(fd);
+  if ( addr == MAP_FAILED ) {
+    std::cerr << "cg: can not map " << name << std::endl;
+    return false;
+  }
+
+  data_ = static_cast<const char *>(addr);
+  size_ = st.st_size;
+
+  // check the header
+  uint32_t hdr[3];
+  std::memcpy(hdr,data_+sizeof(bin::magic),sizeof(hdr));
+  if ( std::memcmp(data_,bin::magic,sizeof(bin::magic)) != 0
+      || hdr[0] == 0U || hdr[0] > bin::version ) {
+    std::cerr << "cg: " << name << " is not a readable binary graph file" << std::endl;
+    close();
+    return false;
+  }
+  layout_ = record_layout(hdr[0]);
+
+  // the vector coding follows the header
+  if ( size_ >= bin::header_size+bin::chunk_header_size ) {
+    uint32_t tag;
+    uint64_t len;
+    std::memcpy(&tag,data_+bin::header_size,sizeof(tag));
+    std::memcpy(&len,data_+bin::header_size+sizeof(tag),sizeof(len));
+    bin::vector_coding coding;
+    if ( tag == bin::codingTag && len <= size_-bin::header_size-bin::chunk_header_size ) {
+      if ( !bin::read_coding(data_+bin::header_size+bin::chunk_header_size,len,coding) ) {
+        close();
+        return false;
+      }
+      layout_.set_coding(coding);
+    }
+  }
+
+  // use the event index if the file has one
+  if ( read_index() ) {
+    prepare();
+    return true;
+  }
+
+  // otherwise locate the event chunks
+  uint64_t offset = bin::header_size;
+  while ( offset+bin::chunk_header_size <= size_ ) {
+    uint32_t tag;
+    uint64_t len;
+    std::memcpy(&tag,data_+offset,sizeof(tag));
+    std::memcpy(&len,data_+offset+sizeof(tag),sizeof(len));
+    offset += bin::chunk_header_size;
+    if ( len > size_-offset )
+      break;
+    if ( bin::is_event(tag) )
+      events_.push_back(std::make_pair(offset,len));
+    else if ( tag == bin::namesTag )
+      read_names(offset,len);
+    offset += len;
+  }
+
+  prepare();
+  return true;
+}
+
+// set up the decompressed events
+void cg::mapped_collection::prepare() {
+  once_.reset(new std::once_flag[events_.size()]);
+  inflated_.assign(events_.size(),std::vector<char>());
+}
+
+// decompress an event
+cg::node_view cg::mapped_collection::inflate(size_t i) const {
+  std::call_once(once_[i],[this,i]() {
+    if ( !bin::decompress(data_+events_[i].first,events_[i].second,inflated_[i]) )
+      std::cerr << "cg: corrupt compressed event " << i << std::endl;
+  });
+  const std::vector<char> & rec = inflated_[i];
+  return node_view(rec.data(),rec.data()+rec.size(),&layout_);
+}
+
+// read the event index
+bool cg::mapped_collection::read_index() {
+
+  if ( size_ < bin::header_size+bin::trailer_size )
+    return false;
+
+  // the trailer
+  uint32_t tag;
+  uint64_t len, offset;
+  const char * p = data_+size_-bin::trailer_size;
+  std::memcpy(&tag,p,sizeof(tag));
+  std::memcpy(&len,p+4,sizeof(len));
+  std::memcpy(&offset,p+12,sizeof(offset));
+  if ( tag != bin::trailerTag || len != sizeof(offset) || offset > size_ || size_-offset < bin::chunk_header_size+8 )
+    return false;
+
+  // the index
+  uint64_t n;
+  p = data_+offset;
+  std::memcpy(&tag,p,sizeof(tag));
+  std::memcpy(&len,p+4,sizeof(len));
+  std::memcpy(&n,p+12,sizeof(n));
+  if ( tag != bin::indexTag || n > (size_-offset)/16 || len != 8+n*16 || len > size_-offset-bin::chunk_header_size )
+    return false;
+
+  events_.resize(n);
+  for ( uint64_t i=0; i != n; i++ )
+    events_[i] = std::make_pair(load<uint64_t>(p+20+16*i),load<uint64_t>(p+28+16*i));
+
+  // check the entries
+  for ( uint64_t i=0; i != n; i++ ) {
+    if ( events_[i].first < bin::header_size+bin::chunk_header_size || events_[i].first > size_ || events_[i].second > size_-events_[i].first ) {
+      events_.clear();
+      return false;
+    }
+  }
+
+  // the names follow the index
+  offset += bin::chunk_header_size+len;
+  while ( offset+bin::chunk_header_size <= size_ ) {
+    std::memcpy(&tag,data_+offset,sizeof(tag));
+    std::memcpy(&len,data_+offset+sizeof(tag),sizeof(len));
+    offset += bin::chunk_header_size;
+    if ( tag != bin::namesTag || len > size_-offset || !read_names(offset,len) )
+      break;
+    offset += len;
+  }
+
+  return true;
+}
+
+// read a name chunk
+bool cg::mapped_collection::read_names(uint64_t offset, uint64_t len) {
+  const char * p = data_+offset;
+  const char * end = p+len;
+  if ( len < 8U )
+    return false;
+
+  uint32_t first, n;
+  std::memcpy(&first,p,sizeof(first));
+  std::memcpy(&n,p+4,sizeof(n));
+  p += 8;
+  if ( uint64_t(first)+n > size_t(name_table::blockSize)*name_table::maxBlocks )
+    return false;
+
+  if ( layout_.names.size() < first+n ) {
+    layout_.names.resize(first+n);
+    layout_.ids.resize(first+n,0U);
+  }
+
+  // the names are viewed in place
+  for ( uint32_t i=0; i != n; i++ ) {
+    uint16_t sz;
+    if ( end-p < 2 )
+      return false;
+    std::memcpy(&sz,p,sizeof(sz));
+    p += 2;
+    if ( end-p < sz )
+      return false;
+    layout_.names[first+i] = std::string_view(p,sz);
+    layout_.ids[first+i] = process_names().intern(layout_.names[first+i]);
+    p += sz;
+  }
+
+  return true;
+}
+
+// build the node objects of all events
+cg::node_collection cg::mapped_collection::extract(unsigned nthreads) const {
+  node_collection nc(events_.size(),NULL);
+
+  if ( nthreads == 0U )
+    nthreads = std::max(1U,std::thread::hardware_concurrency());
+  nthreads = std::min<size_t>(nthreads,std::max<size_t>(events_.size(),1U));
+
+  // each thread takes the next event until none are left
+  std::atomic<size_t> next(0U);
+  auto work = [this,&nc,&next]() {
+    std::vector<char> rec;
+    size_t i;
+    while ( (i = next.fetch_add(1U,std::memory_order_relaxed)) < nc.size() ) {
+      if ( !compressed(i) ) {
+        nc[i] = (*this)[i].extract();
+        continue;
+      }
+      // decompress into a buffer of this thread, not the cache
+      if ( bin::decompress(data_+events_[i].first,events_[i].second,rec) )
+        nc[i] = node_view(rec.data(),rec.data()+rec.size(),&layout_).extract();
+      else
+        std::cerr << "cg: corrupt compressed event " << i << std::endl;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for ( unsigned k=1; k < nthreads; k++ )
+    threads.emplace_back(work);
+  work();
+  for ( std::thread & thr : threads )
+    thr.join();
+
+  // end before the first event which could not be decoded
+  auto bad = std::find(nc.begin(),nc.end(),static_cast<node *>(NULL));
+  for ( auto it = bad; it != nc.end(); ++it )
+    delete *it;
+  nc.erase(bad,nc.end());
+
+  return nc;
+}
+
+// read a collection decoding events in parallel
+cg::node_collection cg::ReadCollectionParallel(const std::string & name, unsigned nthreads) {
+  if ( DetectFormat(name) != binaryFormat )
+    return ReadCollection(name,textFormat);
+
+  mapped_collection mc(name);
+  return mc.extract(nthreads);
+}
+
+// unmap the file
+void cg::mapped_collection::close() {
+  if ( data_ )
+    munmap(const_cast<char *>(data_),size_);
+  data_ = NULL;
+  size_ = 0U;
+  layout_ = record_layout(0U);
+  events_.clear();
+  once_.reset();
+  inflated_.clear();
+}
+
+
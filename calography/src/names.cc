@@ -0,0 +1,70 @@
+
+
+#include "names.h"
+
+#include <iostream>
+
+
+// constructor
+cg::name_table::name_table()
+  :size_(0U)
+{
+  for ( unsigned k=0; k != maxBlocks; k++ )
+    blocks_[k].store(NULL,std::memory_order_relaxed);
+  intern(std::string_view());
+}
+
+// destructor
+cg::name_table::~name_table() {
+  for ( unsigned k=0; k != maxBlocks; k++ )
+    delete [] blocks_[k].load(std::memory_order_relaxed);
+}
+
+// intern a name
+cg::name_id cg::name_table::intern(std::string_view name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto it = ids_.find(name);
+  if ( it != ids_.end() )
+    return it->second;
+
+  const size_t n = size_.load(std::memory_order_relaxed);
+  if ( n == size_t(blockSize)*maxBlocks ) {
+    std::cerr << "cg: too many names, " << name << " is not stored" << std::endl;
+    return 0U;
+  }
+
+  // store the name, then publish it
+  std::string * block = blocks_[n/blockSize].load(std::memory_order_relaxed);
+  if ( !block ) {
+    block = new std::string[blockSize];
+    blocks_[n/blockSize].store(block,std::memory_order_release);
+  }
+  block[n%blockSize] = name;
+  ids_.emplace(std::string(name),name_id(n));
+  size_.store(n+1U,std::memory_order_release);
+
+  return n;
+}
+
+// look up a name
+int32_t cg::name_table::lookup(std::string_view name) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = ids_.find(name);
+  return it == ids_.end() ? -1 : it->second;
+}
+
+// get a name
+std::string_view cg::name_table::name(name_id id) const {
+  if ( id >= size() )
+    return std::string_view();
+  return blocks_[id/blockSize].load(std::memory_order_acquire)[id%blockSize];
+}
+
+
+// the process names
+cg::name_table & cg::process_names() {
+  static name_table table;
+  return table;
+}
+
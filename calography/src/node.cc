@@ -2,80 +2,395 @@
 #include "node.h"
 
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <algorithm>
 
 #include "CaloGraphyIO.h"
+#include "traverse.h"
 
 
-// instantiate the static node count
-unsigned cg::node::nNodes_ = 0U;
+// instantiate the shared id counter
+std::atomic<cg::node_id> cg::node::nextBlock_(0U);
+
+// allocate an id
+cg::node_id cg::node::next_id() {
+  thread_local node_id next = 0U, last = 0U;
+  if ( next == last ) {
+    next = nextBlock_.fetch_add(idBlock,std::memory_order_relaxed);
+    last = next+idBlock;
+  }
+  return next++;
+}
+
+// each allocation is preceded by a word recording where it came from
+namespace { const size_t allocHeader = alignof(std::max_align_t); }
+
+// allocate
+void * cg::node::operator new(std::size_t sz) {
+  arena * pool = arena::current();
+  char * p = static_cast<char *>(pool ? pool->allocate(sz+allocHeader,allocHeader) : ::operator new(sz+allocHeader));
+  *reinterpret_cast<uintptr_t *>(p) = pool ? 1U : 0U;
+  return p+allocHeader;
+}
+
+// free
+void cg::node::operator delete(void * p) {
+  if ( !p )
+    return;
+  char * blk = static_cast<char *>(p)-allocHeader;
+  if ( *reinterpret_cast<uintptr_t *>(blk) == 0U )
+    ::operator delete(blk);
+}
 
 // destructor
 cg::node::~node() {
-  const unsigned nkids = children_.size();
-  for ( unsigned i=0; i != nkids; i++ )
-    delete children_[i];
+
+  // detach the descendants and delete them one by one, each is deleted
+  // without children so the destructors do not recurse
+  std::vector<node *> doomed(children_.begin(),children_.end());
+  children_.clear();
+  while ( !doomed.empty() ) {
+    node * nd = doomed.back();
+    doomed.pop_back();
+    doomed.insert(doomed.end(),nd->children_.begin(),nd->children_.end());
+    nd->children_.clear();
+    delete nd;
+  }
+
+  if ( agg_ )
+    std::pmr::polymorphic_allocator<aggregate>(children_.get_allocator().resource()).deallocate(agg_,1U);
+  if ( index_ && index_->root() == this ) {
+    index_->~node_index();
+    std::pmr::polymorphic_allocator<node_index>(children_.get_allocator().resource()).deallocate(index_,1U);
+  }
+}
+
+
+namespace {
+
+  // write the text format
+  struct text_writer : public cg::visitor {
+    explicit text_writer(std::ostream & s):stream(s) { }
+
+    template<typename N>
+    cg::visit_action pre(const N & nd, unsigned) {
+      nd.N::serialize_fields(stream);
+      stream << nd.children().size() << " ";
+      return cg::visitContinue;
+    }
+
+    std::ostream & stream;
+  };
+
+  // write the binary format
+  struct binary_writer : public cg::visitor {
+    explicit binary_writer(cg::bin::obuffer & b):buf(b) { }
+
+    template<typename N>
+    cg::visit_action pre(const N & nd, unsigned depth) {
+      // positions are relative to the parent as it is read back
+      if ( buf.coding().relative() ) {
+        origins.resize(depth+1U,cg::relvec(0.,0.,0.,0.));
+        if ( depth )
+          buf.set_origin(origins[depth-1]);
+        origins[depth] = buf.coding().rounded(nd.pos(),buf.origin());
+      }
+
+      buf.put<uint8_t>(nd.type());
+
+      // reserve the field length and fill it in after the fields are written
+      const size_t lenpos = buf.size();
+      buf.put<uint32_t>(0U);
+      nd.N::write_fields(buf);
+      buf.put_at<uint32_t>(lenpos,buf.size()-lenpos-sizeof(uint32_t));
+
+      buf.put<uint32_t>(nd.children().size());
+
+      // reserve the length of the child records, filled in by post()
+      buf.put<uint32_t>(0U);
+      if ( starts.size() <= depth )
+        starts.resize(depth+1U);
+      starts[depth] = buf.size();
+      return cg::visitContinue;
+    }
+
+    template<typename N>
+    void post(const N &, unsigned depth) {
+      const size_t len = buf.size()-starts[depth];
+      buf.put_at<uint32_t>(starts[depth]-sizeof(uint32_t),
+          len < cg::bin::unknownLength ? uint32_t(len) : cg::bin::unknownLength);
+    }
+
+    cg::bin::obuffer & buf;
+    std::vector<cg::relvec> origins;
+    std::vector<size_t> starts;
+  };
+
+  // print nodes
+  struct printer : public cg::visitor {
+    explicit printer(int l):lvl(l) { }
+
+    template<typename N>
+    cg::visit_action pre(const N & nd, unsigned depth) {
+      nd.N::print_node(lvl+depth);
+      return cg::visitContinue;
+    }
+
+    int lvl;
+  };
+
+  // collect nodes
+  struct collector : public cg::visitor {
+    explicit collector(std::vector<const cg::node *> & n):nodes(n) { }
+
+    template<typename N>
+    cg::visit_action pre(const N & nd, unsigned) {
+      nodes.push_back(&nd);
+      return cg::visitContinue;
+    }
+
+    std::vector<const cg::node *> & nodes;
+  };
+
+  // look up a node id
+  struct finder : public cg::visitor {
+    explicit finder(cg::node_id i):id(i),found(NULL) { }
+
+    template<typename N>
+    cg::visit_action pre(N & nd, unsigned) {
+      if ( nd.id() != id )
+        return cg::visitContinue;
+      found = &nd;
+      return cg::visitStop;
+    }
+
+    cg::node_id id;
+    cg::node * found;
+  };
+
+  // look up the first node of a Geant4 track
+  struct track_finder : public cg::visitor {
+    using cg::visitor::pre;
+    explicit track_finder(unsigned i):g4id(i),found(NULL) { }
+
+    cg::visit_action pre(cg::track & trk, unsigned) {
+      if ( trk.G4TrackID() != g4id )
+        return cg::visitContinue;
+      found = &trk;
+      return cg::visitStop;
+    }
+
+    cg::visit_action pre(cg::trajectory & trj, unsigned depth) {
+      return pre(static_cast<cg::track &>(trj),depth);
+    }
+
+    unsigned g4id;
+    cg::track * found;
+  };
+
 }
 
 
 // serialize
 void cg::node::serialize(std::ostream & stream) const {
-  stream << id_ << " " << (unsigned)type_ << " " << energy_ << " " << pos_ << " ";
+  text_writer wrt(stream);
+  traverse(this,wrt);
+}
 
-  const unsigned nkids = children_.size();
-  stream << nkids << " ";
-  for ( unsigned i=0; i != nkids; i++ ) {
-    children_[i]->serialize(stream);
-  }
+// serialize the node fields
+void cg::node::serialize_fields(std::ostream & stream) const {
+  stream << id_ << " " << (unsigned)type_ << " " << energy_ << " " << pos_ << " ";
 }
 
 // deserialize
 void cg::node::deserialize(std::istream & stream) {
+  deserialize_fields(stream);
+  deserialize_children(stream);
+}
+
+// deserialize the node fields
+void cg::node::deserialize_fields(std::istream & stream) {
   unsigned tmptype;
   stream >> id_ >> tmptype >> energy_ >> pos_;
   type_ = static_cast<node_type>(tmptype);
-
-  deserialize_children(stream);
-
 }
 
 // deserialze the child nodes
 void cg::node::deserialize_children(std::istream & stream) {
 
+  // stack of nodes and the number of their children still to be read
+  std::vector<std::pair<node *,size_t> > stack;
   size_t num;
   stream >> num;
-  for ( unsigned i=0; i != num; i++ ) {
-
-    node * nd = extract_node(stream);
+  stack.push_back(std::make_pair(this,num));
 
-    children_.push_back(nd);
+  while ( !stack.empty() ) {
+    if ( stack.back().second == 0U ) {
+      stack.pop_back();
+      continue;
+    }
+    stack.back().second--;
+    node * parent = stack.back().first;
+
+    node * nd = make_node(stream);
+    if ( !nd )
+      break;
+    nd->deserialize_fields(stream);
+    parent->children_.push_back(nd);
+    nd->parent_ = parent;
+
+    stream >> num;
+    stack.push_back(std::make_pair(nd,num));
   }
 
+}
+
 
+// write (binary)
+void cg::node::write(bin::obuffer & buf) const {
+  binary_writer wrt(buf);
+  const relvec origin = buf.origin();
+  traverse(this,wrt);
+  buf.set_origin(origin);
+}
 
+// read (binary)
+void cg::node::read(bin::ibuffer & buf) {
+
+  // read a record without the children, skipping any fields
+  // not understood by this version
+  auto record = [&buf](node * nd) {
+    nd->type_ = static_cast<node_type>(buf.get<uint8_t>());
+    const uint32_t len = buf.get<uint32_t>();
+    const size_t start = buf.tell();
+    nd->read_fields(buf);
+    buf.seek(start+len);
+    const uint32_t nkids = buf.get<uint32_t>();
+    buf.skip(bin::tail_size(buf.version())-sizeof(uint32_t));
+    return nkids;
+  };
+
+  // the root is relative to the origin of the buffer, the other nodes to their parent
+  const relvec origin = buf.origin();
+
+  // stack of nodes and the number of their children still to be read
+  std::vector<std::pair<node *,uint32_t> > stack;
+  stack.push_back(std::make_pair(this,record(this)));
+
+  while ( !stack.empty() && buf.good() ) {
+    if ( stack.back().second == 0U ) {
+      stack.pop_back();
+      continue;
+    }
+    stack.back().second--;
+    node * parent = stack.back().first;
+
+    node * nd = make_node(buf);
+    if ( !nd )
+      break;
+    buf.set_origin(parent->pos_);
+    const uint32_t num = record(nd);
+    parent->children_.push_back(nd);
+    nd->parent_ = parent;
+    stack.push_back(std::make_pair(nd,num));
+  }
 
+  buf.set_origin(origin);
+}
+
+// write the node fields (binary)
+void cg::node::write_fields(bin::obuffer & buf) const {
+  buf.put<uint64_t>(id_);
+  buf.put<float>(energy_);
+  buf.put_pos(pos_,buf.origin());
+}
+
+// read the node fields (binary)
+void cg::node::read_fields(bin::ibuffer & buf) {
+  id_ = buf.get_id();
+  energy_ = buf.get<float>();
+  buf.get_pos(pos_,buf.origin());
 }
 
 
 // print
 void cg::node::print(int lvl) const {
+  printer prt(lvl);
+  traverse(this,prt);
+}
+
+// print this node
+void cg::node::print_node(int lvl) const {
   std::cout << std::string(lvl,' ') << "Node "
     << id_ << " " << energy_ << " Pos(" << pos_ << ")" << std::endl;
-  
-  const unsigned kids = children_.size();
-  for ( unsigned i=0; i != kids; i++ ) {
-    children_[i]->print(lvl+1);
-  }
 }
 
 // provenance
 std::vector<const cg::node*> cg::node::provenance() const {
-  return std::vector<const cg::node*>(0);
+  std::vector<const cg::node*> nodes;
+  for ( const node * nd = parent_; nd; nd = nd->parent_ )
+    nodes.push_back(nd);
+  return nodes;
 }
 
 // total energy
 double cg::node::totalenergy() const {
-  return 0;
+  return aggregates().energy;
+}
+
+// aggregates
+const cg::aggregate & cg::node::aggregates() const {
+  if ( agg_ && agg_->valid )
+    return *agg_;
+
+  // post-order over the nodes with stale aggregates
+  std::vector<std::pair<const node *,bool> > stack;
+  stack.push_back(std::make_pair(this,false));
+  while ( !stack.empty() ) {
+    const node * nd = stack.back().first;
+    if ( !stack.back().second ) {
+      stack.back().second = true;
+      for ( const node * kid : nd->children_ )
+        if ( !kid->agg_ || !kid->agg_->valid )
+          stack.push_back(std::make_pair(kid,false));
+      continue;
+    }
+    stack.pop_back();
+
+    // this node, then the children (which are all up to date)
+    if ( !nd->agg_ )
+      nd->agg_ = std::pmr::polymorphic_allocator<aggregate>(nd->children_.get_allocator().resource()).allocate(1U);
+    aggregate & agg = *nd->agg_;
+    agg.energy = nd->energy_;
+    agg.nodes = 1U;
+    const relvec & p = nd->pos_;
+    const float pos[4] = { float(p.t_), float(p.x_), float(p.y_), float(p.z_) };
+    std::copy(pos,pos+4,agg.lo);
+    std::copy(pos,pos+4,agg.hi);
+    if ( nd->type_ == trajectoryNode ) {
+      for ( const step_point & pt : static_cast<const trajectory *>(nd)->steps() ) {
+        const float sp[4] = { float(pt.pos.t_), float(pt.pos.x_), float(pt.pos.y_), float(pt.pos.z_) };
+        for ( unsigned k=0; k != 4; k++ ) {
+          agg.lo[k] = std::min(agg.lo[k],sp[k]);
+          agg.hi[k] = std::max(agg.hi[k],sp[k]);
+        }
+      }
+    }
+    for ( const node * kid : nd->children_ ) {
+      const aggregate & ka = *kid->agg_;
+      agg.energy += ka.energy;
+      agg.nodes += ka.nodes;
+      for ( unsigned k=0; k != 4; k++ ) {
+        agg.lo[k] = std::min(agg.lo[k],ka.lo[k]);
+        agg.hi[k] = std::max(agg.hi[k],ka.hi[k]);
+      }
+    }
+    agg.valid = true;
+  }
+
+  return *agg_;
 }
 
 // shower
@@ -85,55 +400,92 @@ std::vector<const cg::node*> cg::node::shower() const {
   std::vector<const cg::node *> nodes;
 
   // explore the graph
-  this->shower(nodes);
+  collector col(nodes);
+  traverse(this,col);
 
   // return the vector
   return nodes;
 }
 
-// shower (append to data)
-void cg::node::shower(std::vector<const node *> & nodes) const {
+// get node
+cg::node * cg::node::find(const node_id id) {
+  if ( !index_ ) {
+    finder fnd(id);
+    traverse(this,fnd);
+    return fnd.found;
+  }
 
-  // append this node
-  nodes.push_back(this);
+  // the node must be below this one if the index belongs to an ancestor;
+  // the id may repeat below this node if the indexed node is elsewhere
+  node * nd = index_->find(id);
+  if ( index_->root() == this || !nd )
+    return nd;
+  for ( node * up = nd; up; up = up->parent_ ) {
+    if ( up == this )
+      return nd;
+  }
+  finder fnd(id);
+  traverse(this,fnd);
+  return fnd.found;
+}
 
-  // explore children
-  const unsigned nkids = children_.size();
-  for ( unsigned i=0; i != nkids; i++ )
-    children_[i]->shower(nodes);
+// get the first node of a track
+cg::track * cg::node::find_track(unsigned g4id) {
+  if ( !index_ ) {
+    track_finder fnd(g4id);
+    traverse(this,fnd);
+    return fnd.found;
+  }
 
+  // the first node below this one if the index belongs to an ancestor
+  if ( index_->root() == this )
+    return index_->find_track(g4id);
+  for ( track * trk : index_->tracks(g4id) ) {
+    for ( node * up = trk; up; up = up->parent_ ) {
+      if ( up == this )
+        return trk;
+    }
+  }
+  return NULL;
 }
 
-// get node
-cg::node * cg::node::find(const unsigned id) {
-
-  // check this node
-  if ( id_ == id )
-    return this;
-
-  else {
-    // explore children
-    const unsigned nkids = children_.size();
-    for ( unsigned i=0; i != nkids; i++ ) {
-      cg::node * nd = children_[i]->find(id);
-      if ( nd ) 
-        return nd;
-    }
+// build the index
+void cg::node::build_index() {
+  if ( index_ && index_->root() != this )
+    return;
+
+  node_index * idx = index_;
+  if ( idx ) {
+    idx->clear();
+  } else {
+    std::pmr::memory_resource * res = children_.get_allocator().resource();
+    idx = new (std::pmr::polymorphic_allocator<node_index>(res).allocate(1U)) node_index(this,res);
   }
+  idx->insert(this);
+}
 
-  // return NULL
-  return NULL;
+// remove the index
+void cg::node::drop_index() {
+  if ( !index_ || index_->root() != this )
+    return;
+
+  node_index * idx = index_;
+  idx->clear();
+  idx->~node_index();
+  std::pmr::polymorphic_allocator<node_index>(children_.get_allocator().resource()).deallocate(idx,1U);
 }
 
 
 // set the position
 void cg::node::set_pos(const relvec & pos) {
   pos_ = pos;
+  invalidate();
 }
 
 // set the energy
 void cg::node::set_energy(const float E) {
   energy_ = E;
+  invalidate();
 }
 
 
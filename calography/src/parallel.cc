@@ -0,0 +1,257 @@
+
+
+#include "parallel.h"
+#include "reader.h"
+
+#include <algorithm>
+
+
+namespace {
+
+  // the pool and index of a worker thread
+  thread_local const cg::thread_pool * currentPool = NULL;
+  thread_local unsigned currentWorker = 0U;
+
+}
+
+
+// constructor
+cg::thread_pool::thread_pool(unsigned nthreads)
+  :queued_(0U)
+  ,sleeping_(0U)
+  ,stop_(false)
+  ,next_(0U)
+{
+  if ( nthreads == 0U )
+    nthreads = std::max(1U,std::thread::hardware_concurrency());
+
+  // the queues are in place before the workers start
+  for ( unsigned k=0; k != nthreads; k++ )
+    queues_.emplace_back(new queue);
+  for ( unsigned k=0; k != nthreads; k++ )
+    threads_.emplace_back(&thread_pool::work,this,k);
+}
+
+// destructor
+cg::thread_pool::~thread_pool()
+{
+  {
+    std::lock_guard<std::mutex> l(sleep_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for ( std::thread & thr : threads_ )
+    thr.join();
+}
+
+
+// index of the calling thread
+int cg::thread_pool::worker() const
+{
+  return currentPool == this ? int(currentWorker) : -1;
+}
+
+
+// start a job
+void cg::thread_pool::start(job & jb)
+{
+  if ( jb.n_ == 0U )
+    return;
+
+  // a job of a worker of this pool runs on the worker
+  const int self = worker();
+  if ( self >= 0 ) {
+    jb.body_(0U,jb.n_,unsigned(self));
+    finish(jb,jb.n_);
+    return;
+  }
+
+  if ( jb.grain_ == 0U )
+    jb.grain_ = std::max<size_t>(1U,jb.n_/(64U*size()));
+
+  // jobs are given to the workers in turn, the others steal from it
+  push(next_.fetch_add(1U,std::memory_order_relaxed) % size(),range{&jb,0U,jb.n_});
+}
+
+// wait for a job
+void cg::thread_pool::wait(job & jb)
+{
+  // the job may be destroyed once done_ is seen under the lock
+  std::unique_lock<std::mutex> l(jb.lock_);
+  while ( !jb.done_ )
+    jb.finished_.wait(l);
+}
+
+
+// worker loop
+void cg::thread_pool::work(unsigned w)
+{
+  currentPool = this;
+  currentWorker = w;
+
+  range r;
+  for (;;) {
+    if ( take(w,r) ) {
+      execute(w,r);
+      continue;
+    }
+
+    // sleep until a range is queued, registered as sleeping before
+    // queued_ is checked so that push() does not miss the worker
+    std::unique_lock<std::mutex> l(sleep_);
+    sleeping_++;
+    while ( queued_.load() == 0U && !stop_ )
+      wake_.wait(l);
+    sleeping_--;
+    if ( stop_ && queued_.load() == 0U )
+      return;
+  }
+}
+
+// take a range
+bool cg::thread_pool::take(unsigned w, range & r)
+{
+  if ( queued_.load() == 0U )
+    return false;
+
+  // the last range queued by this worker (the smallest)
+  {
+    queue & own = *queues_[w];
+    std::lock_guard<std::mutex> l(own.lock);
+    if ( !own.ranges.empty() ) {
+      r = own.ranges.back();
+      own.ranges.pop_back();
+      queued_--;
+      return true;
+    }
+  }
+
+  // steal the first range queued by another worker (the largest)
+  const unsigned n = size();
+  for ( unsigned k=1; k < n; k++ ) {
+    queue & q = *queues_[(w+k) % n];
+    std::lock_guard<std::mutex> l(q.lock);
+    if ( !q.ranges.empty() ) {
+      r = q.ranges.front();
+      q.ranges.pop_front();
+      queued_--;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// queue a range
+void cg::thread_pool::push(unsigned w, const range & r)
+{
+  // counted first so the count never falls below the queued ranges
+  queued_++;
+  {
+    queue & q = *queues_[w];
+    std::lock_guard<std::mutex> l(q.lock);
+    q.ranges.push_back(r);
+  }
+  if ( sleeping_.load() != 0U ) {
+    std::lock_guard<std::mutex> l(sleep_);
+    wake_.notify_one();
+  }
+}
+
+// split and run a range
+void cg::thread_pool::execute(unsigned w, range r)
+{
+  job & jb = *r.jb;
+
+  // the upper halves are queued, to be run next or stolen
+  while ( r.end-r.begin > jb.grain_ ) {
+    const size_t mid = r.begin + (r.end-r.begin)/2U;
+    push(w,range{r.jb,mid,r.end});
+    r.end = mid;
+  }
+
+  jb.body_(r.begin,r.end,w);
+  finish(jb,r.end-r.begin);
+}
+
+// count indices as run
+void cg::thread_pool::finish(job & jb, size_t n)
+{
+  if ( jb.remaining_.fetch_sub(n,std::memory_order_acq_rel) != n )
+    return;
+  std::lock_guard<std::mutex> l(jb.lock_);
+  jb.done_ = true;
+  jb.finished_.notify_all();
+}
+
+
+// shared pool
+cg::thread_pool & cg::default_pool()
+{
+  static thread_pool pool;
+  return pool;
+}
+
+
+namespace {
+
+  // events read from a file and the job visiting them
+  struct read_batch {
+    cg::node_collection events;
+    size_t first;
+    std::unique_ptr<cg::thread_pool::job> jb;
+  };
+
+}
+
+// visit the events of a reader
+size_t cg::parallel_read(collection_reader & reader,
+    const std::function<void(node * nd, size_t i, unsigned worker)> & fn,
+    thread_pool & pool)
+{
+  size_t n = 0U;
+
+  // pooled graphs are reset by the next read, visit them here (as does
+  // a worker of the pool)
+  const int self = pool.worker();
+  if ( reader.pooled() || self >= 0 ) {
+    const unsigned w = self >= 0 ? unsigned(self) : 0U;
+    for ( node * nd = reader.next(); nd; nd = reader.next() )
+      fn(nd,n++,w);
+    return n;
+  }
+
+  // batches of a few events per worker are read while up to maxBatches
+  // earlier batches are visited, a batch is freed once it is visited
+  const size_t batchSize = 2U*pool.size();
+  const size_t maxBatches = 4U;
+  std::deque<std::unique_ptr<read_batch> > running;
+  for (;;) {
+    std::unique_ptr<read_batch> bt(new read_batch);
+    bt->first = n;
+    while ( bt->events.size() != batchSize && reader.next() )
+      bt->events.push_back(reader.release());
+    n += bt->events.size();
+    const bool last = bt->events.size() != batchSize;
+
+    if ( !bt->events.empty() ) {
+      const read_batch * b = bt.get();
+      bt->jb.reset(new thread_pool::job(b->events.size(),[b,&fn](size_t begin, size_t end, unsigned w) {
+        for ( size_t i=begin; i != end; i++ )
+          fn(b->events[i],b->first+i,w);
+      }));
+      pool.start(*bt->jb);
+      running.push_back(std::move(bt));
+    }
+
+    while ( !running.empty() && (last || running.size() == maxBatches) ) {
+      pool.wait(*running.front()->jb);
+      for ( node * nd : running.front()->events )
+        delete nd;
+      running.pop_front();
+    }
+    if ( last )
+      return n;
+  }
+}
+
@@ -0,0 +1,77 @@
+
+
+#include "policy.h"
+
+#include <algorithm>
+
+
+// constructor
+cg::recording_policy::recording_policy() {
+  clear();
+}
+
+// record everything
+void cg::recording_policy::clear() {
+  minDeposit_ = -std::numeric_limits<double>::infinity();
+  minTrackEnergy_ = -std::numeric_limits<double>::infinity();
+  maxDepth_ = std::numeric_limits<unsigned>::max();
+  tmin_ = -std::numeric_limits<double>::infinity();
+  tmax_ = std::numeric_limits<double>::infinity();
+  procs_.clear();
+  procAllowList_ = false;
+  allowedPdgs_.clear();
+  deniedPdgs_.clear();
+}
+
+// check for the default policy
+bool cg::recording_policy::records_all() const {
+  return minDeposit_ == -std::numeric_limits<double>::infinity()
+    && minTrackEnergy_ == -std::numeric_limits<double>::infinity()
+    && maxDepth_ == std::numeric_limits<unsigned>::max()
+    && tmin_ == -std::numeric_limits<double>::infinity()
+    && tmax_ == std::numeric_limits<double>::infinity()
+    && procs_.empty() && allowedPdgs_.empty() && deniedPdgs_.empty();
+}
+
+// allow a process
+void cg::recording_policy::allow_process(std::string_view name) {
+  const name_id id = process_names().intern(name);
+  if ( id >= procs_.size() )
+    procs_.resize(id+1U,0U);
+  procs_[id] = allowed;
+  procAllowList_ = true;
+}
+
+// deny a process
+void cg::recording_policy::deny_process(std::string_view name) {
+  const name_id id = process_names().intern(name);
+  if ( id >= procs_.size() )
+    procs_.resize(id+1U,0U);
+  procs_[id] = denied;
+}
+
+// allow a particle
+void cg::recording_policy::allow_particle(int pdg) {
+  auto it = std::lower_bound(allowedPdgs_.begin(),allowedPdgs_.end(),pdg);
+  if ( it == allowedPdgs_.end() || *it != pdg )
+    allowedPdgs_.insert(it,pdg);
+}
+
+// deny a particle
+void cg::recording_policy::deny_particle(int pdg) {
+  auto it = std::lower_bound(deniedPdgs_.begin(),deniedPdgs_.end(),pdg);
+  if ( it == deniedPdgs_.end() || *it != pdg )
+    deniedPdgs_.insert(it,pdg);
+}
+
+// check a secondary
+bool cg::recording_policy::accept_track(int pdg, double E, unsigned depth) const {
+  if ( E < minTrackEnergy_ || depth > maxDepth_ )
+    return false;
+  if ( !deniedPdgs_.empty() && std::binary_search(deniedPdgs_.begin(),deniedPdgs_.end(),pdg) )
+    return false;
+  if ( !allowedPdgs_.empty() && !std::binary_search(allowedPdgs_.begin(),allowedPdgs_.end(),pdg) )
+    return false;
+  return true;
+}
+
@@ -2,38 +2,49 @@
 #include "process.h"
 
 #include <iostream>
+#include <string>
 
 
-// print
-void cg::process::print(int lvl) const {
+// print this node
+void cg::process::print_node(int lvl) const {
   std::cout << std::string(lvl,' ') << "Process "
-    << id_ << " " << procName_ << " " << energy_ << " Pos(" << pos_ << ")" << std::endl;
-
-  const unsigned nkids = children_.size();
-  for ( unsigned i=0; i != nkids; i++ ) {
-    children_[i]->print(lvl+1);
-  }   
+    << id_ << " " << name() << " " << energy_ << " Pos(" << pos_ << ")" << std::endl;
 }
 
 
-// serialize
-void cg::process::serialize(std::ostream & stream) const {
-  stream << id_ << " " << type_ << " " << procName_ << " " << energy_ << " " << pos_ << " ";
-
-  const unsigned nkids = children_.size();
-  stream << nkids << " ";
-  for ( unsigned i=0; i != nkids; i++ ) {
-    children_[i]->serialize(stream);
-  }
+// serialize the process fields
+void cg::process::serialize_fields(std::ostream & stream) const {
+  stream << id_ << " " << type_ << " " << name() << " " << energy_ << " " << pos_ << " ";
 }
 
 
-// deserialize
-void cg::process::deserialize(std::istream & stream) {
+// deserialize the process fields
+void cg::process::deserialize_fields(std::istream & stream) {
   unsigned tmptype;
-  stream >> id_ >> tmptype >> procName_ >> energy_ >> pos_;
+  std::string name;
+  stream >> id_ >> tmptype >> name >> energy_ >> pos_;
   type_ = static_cast<cg::node_type>(tmptype);
+  procId_ = process_names().intern(name);
+}
 
-  deserialize_children(stream);
+// write the process fields (binary)
+void cg::process::write_fields(bin::obuffer & buf) const {
+  node::write_fields(buf);
+  buf.put_name(procId_);
+}
+
+
+// read the process fields (binary)
+void cg::process::read_fields(bin::ibuffer & buf) {
+  node::read_fields(buf);
+
+  // names are stored in the records before version 3
+  if ( buf.version() < 3U ) {
+    std::string name;
+    buf.get(name);
+    procId_ = process_names().intern(name);
+  } else {
+    procId_ = buf.get_name();
+  }
 }
 
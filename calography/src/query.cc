@@ -0,0 +1,281 @@
+
+
+#include "query.h"
+
+#include <algorithm>
+
+
+// select with a filter
+std::vector<cg::compact_graph::index> cg::node_filter::select(const compact_graph & g) const {
+  return compiled_filter(*this).select(g);
+}
+
+
+namespace {
+
+  // check if the node types are tracks or trajectories
+  inline uint8_t is_track(uint8_t type) {
+    return uint8_t(type == cg::trackNode) | uint8_t(type == cg::trajectoryNode);
+  }
+
+}
+
+// fold constant terms
+cg::compiled_filter::term_ptr cg::compiled_filter::fold(const term_ptr & t) {
+  typedef node_filter nf;
+  auto is_op = [](const term_ptr & x, nf::op_code op) { return x->op == op; };
+  static const term_ptr all = nf::all().term_;
+  static const term_ptr none = nf::none().term_;
+
+  switch ( t->op ) {
+  case nf::opNot: {
+    const term_ptr a = fold(t->a);
+    if ( is_op(a,nf::opAll) ) return none;
+    if ( is_op(a,nf::opNone) ) return all;
+    if ( is_op(a,nf::opNot) ) return a->a;
+    return a == t->a ? t : std::make_shared<nf::term>(nf::term{t->op,0.,0.,0,std::string(),a,nullptr});
+  }
+  case nf::opAnd:
+  case nf::opOr: {
+    const term_ptr a = fold(t->a);
+    const term_ptr b = fold(t->b);
+    const nf::op_code absorbing = t->op == nf::opAnd ? nf::opNone : nf::opAll;
+    const nf::op_code neutral = t->op == nf::opAnd ? nf::opAll : nf::opNone;
+    if ( is_op(a,absorbing) || is_op(b,absorbing) ) return is_op(a,absorbing) ? a : b;
+    if ( is_op(a,neutral) ) return b;
+    if ( is_op(b,neutral) ) return a;
+    return a == t->a && b == t->b ? t : std::make_shared<nf::term>(nf::term{t->op,0.,0.,0,std::string(),a,b});
+  }
+  case nf::opParent:
+  case nf::opAncestor: {
+    const term_ptr a = fold(t->a);
+    if ( is_op(a,nf::opNone) ) return none;
+    return a == t->a ? t : std::make_shared<nf::term>(nf::term{t->op,0.,0.,0,std::string(),a,nullptr});
+  }
+  case nf::opEnergy:
+  case nf::opTrackEnergy:
+  case nf::opTime:
+  case nf::opX:
+  case nf::opY:
+  case nf::opZ:
+  case nf::opDepth:
+    // empty ranges select nothing
+    return t->lo < t->hi ? t : none;
+  default:
+    return t;
+  }
+}
+
+// append the program of a term, a term stored with and/or combines its
+// mask with the top mask itself
+unsigned cg::compiled_filter::emit(const node_filter::term & t, store_mode mode) {
+  typedef node_filter nf;
+  const instruction combine{mode == storeAnd ? nf::opAnd : nf::opOr,storePush,0.,0.,0,std::string()};
+
+  switch ( t.op ) {
+  case nf::opAnd:
+  case nf::opOr: {
+    const store_mode same = t.op == nf::opAnd ? storeAnd : storeOr;
+
+    // (x op a) op b, the operands combine in place with the mask below
+    if ( mode == same )
+      return std::max(emit(*t.a,same),emit(*t.b,same));
+
+    // a op b on a new mask
+    const unsigned da = emit(*t.a,storePush);
+    const unsigned db = emit(*t.b,same);
+    if ( mode != storePush )
+      code_.push_back(combine);
+    return std::max(da,db+1U);
+  }
+  case nf::opNot:
+  case nf::opParent:
+  case nf::opAncestor: {
+    // the operand is transformed in place on a new mask
+    const unsigned da = emit(*t.a,storePush);
+    code_.push_back(instruction{t.op,storePush,0.,0.,0,std::string()});
+    if ( mode != storePush )
+      code_.push_back(combine);
+    return da;
+  }
+  default:
+    // a predicate on the columns
+    code_.push_back(instruction{t.op,mode,t.lo,t.hi,t.value,t.name});
+    return mode == storePush ? 1U : 0U;
+  }
+}
+
+// compile
+cg::compiled_filter::compiled_filter(const node_filter & f)
+  :depth_(0U)
+{
+  depth_ = emit(*fold(f.term_),storePush);
+}
+
+
+namespace {
+
+  // store a predicate over all nodes
+  template <class P>
+  void apply(uint8_t * m, size_t n, int mode, P pred) {
+    switch ( mode ) {
+    case 0:
+      for ( size_t i=0; i != n; i++ )
+        m[i] = pred(i);
+      break;
+    case 1:
+      for ( size_t i=0; i != n; i++ )
+        m[i] &= pred(i);
+      break;
+    default:
+      for ( size_t i=0; i != n; i++ )
+        m[i] |= pred(i);
+    }
+  }
+
+  // store a range predicate on a column
+  template <class T>
+  void apply_range(uint8_t * m, size_t n, int mode, const T * v, double lo, double hi) {
+    apply(m,n,mode,[v,lo,hi](size_t i) { return uint8_t(double(v[i]) >= lo) & uint8_t(double(v[i]) < hi); });
+  }
+
+}
+
+// run the program
+void cg::compiled_filter::run(const compact_graph & g, std::vector<std::vector<uint8_t> > & stack) const {
+  typedef node_filter nf;
+  const size_t n = g.size();
+  stack.resize(std::max(depth_,1U));
+
+  const uint8_t * type = g.types().data();
+  const int32_t * parent = g.parents().data();
+  size_t sp = 0U;
+  for ( const instruction & in : code_ ) {
+
+    // operations on the masks
+    if ( in.op == nf::opAnd || in.op == nf::opOr ) {
+      uint8_t * m = stack[sp-2U].data();
+      const uint8_t * b = stack[sp-1U].data();
+      if ( in.op == nf::opAnd )
+        for ( size_t i=0; i != n; i++ ) m[i] &= b[i];
+      else
+        for ( size_t i=0; i != n; i++ ) m[i] |= b[i];
+      sp--;
+      continue;
+    }
+    if ( in.op == nf::opNot || in.op == nf::opParent || in.op == nf::opAncestor ) {
+      uint8_t * m = stack[sp-1U].data();
+      if ( in.op == nf::opNot ) {
+        for ( size_t i=0; i != n; i++ ) m[i] ^= 1U;
+      } else if ( in.op == nf::opParent && n ) {
+        // from the last node, the parents are not yet replaced
+        for ( size_t i=n-1U; i != 0U; i-- ) m[i] = m[parent[i]];
+        m[0] = 0U;
+      } else if ( n ) {
+        // bit 1 is set below a selected node, parents come first
+        for ( size_t i=1; i < n; i++ ) m[i] |= ((m[parent[i]] | (m[parent[i]] >> 1)) & 1U) << 1;
+        for ( size_t i=0; i != n; i++ ) m[i] >>= 1;
+      }
+      continue;
+    }
+
+    // predicates
+    if ( in.mode == storePush )
+      stack[sp++].resize(n);
+    uint8_t * m = stack[sp-1U].data();
+    const double lo = in.lo, hi = in.hi;
+    switch ( in.op ) {
+    case nf::opAll:
+      apply(m,n,in.mode,[](size_t) { return uint8_t(1U); });
+      break;
+    case nf::opNone:
+      apply(m,n,in.mode,[](size_t) { return uint8_t(0U); });
+      break;
+    case nf::opType: {
+      const uint64_t mask = in.value;
+      apply(m,n,in.mode,[type,mask](size_t i) { return uint8_t((mask >> type[i]) & 1U); });
+      break;
+    }
+    case nf::opId: {
+      const node_id * id = g.ids().data();
+      const node_id value = in.value;
+      apply(m,n,in.mode,[id,value](size_t i) { return uint8_t(id[i] == value); });
+      break;
+    }
+    case nf::opPdg: {
+      const int32_t * pdg = g.pdgs().data();
+      const int32_t value = in.value;
+      apply(m,n,in.mode,[type,pdg,value](size_t i) { return uint8_t(pdg[i] == value) & is_track(type[i]); });
+      break;
+    }
+    case nf::opProcess: {
+      // the names are indexed per graph, an unused name selects nothing
+      const int32_t * proc = g.process_ids().data();
+      const int32_t value = g.process_index(in.name);
+      if ( value < 0 )
+        apply(m,n,in.mode,[](size_t) { return uint8_t(0U); });
+      else
+        apply(m,n,in.mode,[proc,value](size_t i) { return uint8_t(proc[i] == value); });
+      break;
+    }
+    case nf::opEnergy:
+      apply_range(m,n,in.mode,g.energies().data(),lo,hi);
+      break;
+    case nf::opTrackEnergy: {
+      const double * e = g.track_energies().data();
+      apply(m,n,in.mode,[type,e,lo,hi](size_t i) {
+        return uint8_t(e[i] >= lo) & uint8_t(e[i] < hi) & is_track(type[i]);
+      });
+      break;
+    }
+    case nf::opTime:
+      apply_range(m,n,in.mode,g.t().data(),lo,hi);
+      break;
+    case nf::opX:
+      apply_range(m,n,in.mode,g.x().data(),lo,hi);
+      break;
+    case nf::opY:
+      apply_range(m,n,in.mode,g.y().data(),lo,hi);
+      break;
+    case nf::opZ:
+      apply_range(m,n,in.mode,g.z().data(),lo,hi);
+      break;
+    case nf::opDepth:
+      apply_range(m,n,in.mode,g.depths().data(),lo,hi);
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+// selection mask
+void cg::compiled_filter::mask(const compact_graph & g, std::vector<uint8_t> & mask) const {
+  std::vector<std::vector<uint8_t> > stack;
+  run(g,stack);
+  mask.swap(stack[0]);
+  mask.resize(g.size());
+}
+
+// selected indices
+std::vector<cg::compact_graph::index> cg::compiled_filter::select(const compact_graph & g) const {
+  std::vector<std::vector<uint8_t> > stack;
+  run(g,stack);
+  const uint8_t * m = stack[0].data();
+  std::vector<index> sel;
+  for ( index i=0; i != g.size(); i++ )
+    if ( m[i] )
+      sel.push_back(i);
+  return sel;
+}
+
+// count the selected nodes
+size_t cg::compiled_filter::count(const compact_graph & g) const {
+  std::vector<std::vector<uint8_t> > stack;
+  run(g,stack);
+  size_t n = 0U;
+  for ( uint8_t b : stack[0] )
+    n += b;
+  return n;
+}
+
@@ -0,0 +1,90 @@
+
+
+#include "reader.h"
+
+#include <iostream>
+
+
+// open a file
+bool cg::collection_reader::open(const std::string & name) {
+
+  close();
+
+  fmt_ = DetectFormat(name);
+  if ( fmt_ == binaryFormat ) {
+    in_.open(name,std::ios::binary);
+    uint32_t flags;
+    if ( !bin::read_header(in_,version_,flags) ) {
+      in_.close();
+      return false;
+    }
+  } else {
+    in_.open(name);
+  }
+
+  if ( !in_.is_open() ) {
+    std::cerr << "cg: can not open " << name << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+// close the file
+void cg::collection_reader::close() {
+  drop();
+  nread_ = 0U;
+  names_.clear();
+  coding_ = bin::vector_coding();
+  if ( in_.is_open() )
+    in_.close();
+  in_.clear();
+}
+
+// drop the current graph
+void cg::collection_reader::drop() {
+  if ( pooled_ )
+    pool_.reset();
+  else
+    delete current_;
+  current_ = NULL;
+}
+
+// read the next graph
+cg::node * cg::collection_reader::next() {
+
+  // drop the previous graph
+  drop();
+
+  if ( !in_.is_open() )
+    return NULL;
+
+  arena::scope pool(pooled_ ? &pool_ : NULL);
+
+  if ( fmt_ == binaryFormat ) {
+    uint32_t tag;
+    while ( bin::read_chunk(in_,tag,payload_) ) {
+      if ( tag == bin::namesTag ) {
+        bin::ibuffer buf(payload_.data(),payload_.size());
+        bin::read_names(buf,names_);
+      } else if ( tag == bin::codingTag && !bin::read_coding(payload_.data(),payload_.size(),coding_) )
+        break;
+      if ( !bin::is_event(tag) )
+        continue;
+      bin::ibuffer buf = bin::event_payload(tag,payload_,raw_,version_);
+      buf.set_names(&names_);
+      buf.set_coding(coding_);
+      current_ = extract_node(buf);
+      break;
+    }
+  } else if ( !in_.eof() && in_.good() && in_.peek() != EOF ) {
+    current_ = extract_node(in_);
+  }
+
+  if ( current_ )
+    nread_++;
+
+  return current_;
+}
+
+
@@ -0,0 +1,143 @@
+
+
+#include "stats.h"
+
+#include <fstream>
+#include <iostream>
+
+
+// add a histogram
+void cg::log_histogram::merge(const log_histogram & h) {
+  for ( unsigned k=0; k != nbins; k++ )
+    bins[k] += h.bins[k];
+  count += h.count;
+  sum += h.sum;
+  if ( h.max > max )
+    max = h.max;
+}
+
+// empty the histogram
+void cg::log_histogram::clear() {
+  for ( unsigned k=0; k != nbins; k++ )
+    bins[k] = 0U;
+  count = 0U;
+  sum = 0.;
+  max = 0.;
+}
+
+// write a histogram
+void cg::log_histogram::write_json(std::ostream & out) const {
+  out << "{ \"count\": " << count << ", \"sum\": " << sum
+    << ", \"mean\": " << (count ? sum/count : 0.) << ", \"max\": " << max
+    << ", \"log2_bins\": [";
+
+  // trailing empty bins are left out
+  unsigned n = nbins;
+  while ( n && !bins[n-1U] )
+    n--;
+  for ( unsigned k=0; k != n; k++ )
+    out << (k ? ", " : "") << bins[k];
+  out << "] }";
+}
+
+
+// add step counters
+void cg::step_counters::merge(const step_counters & c) {
+  steps += c.steps;
+  nodes += c.nodes;
+  edep += c.edep;
+  time.merge(c.time);
+}
+
+
+// add the statistics of another thread
+void cg::build_stats::merge(const build_stats & st) {
+  steps_.merge(st.steps_);
+  if ( procs_.size() < st.procs_.size() )
+    procs_.resize(st.procs_.size());
+  for ( size_t i=0; i != st.procs_.size(); i++ )
+    procs_[i].merge(st.procs_[i]);
+  for ( const auto & part : st.particles_ )
+    particles_[part.first].merge(part.second);
+
+  eventNodes_.merge(st.eventNodes_);
+  eventBytes_.merge(st.eventBytes_);
+  merge_.merge(st.merge_);
+  write_.merge(st.write_);
+  bytes_ += st.bytes_;
+  if ( st.maxStack_ > maxStack_ )
+    maxStack_ = st.maxStack_;
+}
+
+// remove all statistics
+void cg::build_stats::clear() {
+  steps_ = step_counters();
+  procs_.clear();
+  particles_.clear();
+  eventNodes_.clear();
+  eventBytes_.clear();
+  merge_.clear();
+  write_.clear();
+  bytes_ = 0U;
+  maxStack_ = 0U;
+}
+
+
+namespace {
+
+  // write step counters
+  void write_counters(std::ostream & out, const cg::step_counters & c) {
+    out << "{ \"steps\": " << c.steps << ", \"nodes\": " << c.nodes
+      << ", \"edep\": " << c.edep << ", \"time_ns\": ";
+    c.time.write_json(out);
+    out << " }";
+  }
+
+}
+
+// write as JSON
+void cg::build_stats::write_json(std::ostream & out) const {
+  out << "{\n  \"steps\": ";
+  write_counters(out,steps_);
+
+  out << ",\n  \"processes\": {";
+  bool first = true;
+  for ( size_t i=0; i != procs_.size(); i++ ) {
+    if ( !procs_[i].steps )
+      continue;
+    out << (first ? "\n" : ",\n") << "    \"" << process_names().name(i) << "\": ";
+    write_counters(out,procs_[i]);
+    first = false;
+  }
+
+  out << "\n  },\n  \"particles\": {";
+  first = true;
+  for ( const auto & part : particles_ ) {
+    out << (first ? "\n" : ",\n") << "    \"" << part.first << "\": ";
+    write_counters(out,part.second);
+    first = false;
+  }
+
+  out << "\n  },\n  \"event_nodes\": ";
+  eventNodes_.write_json(out);
+  out << ",\n  \"event_bytes\": ";
+  eventBytes_.write_json(out);
+  out << ",\n  \"merge_ns\": ";
+  merge_.write_json(out);
+  out << ",\n  \"write_ns\": ";
+  write_.write_json(out);
+  out << ",\n  \"bytes_written\": " << bytes_
+    << ",\n  \"max_stack_depth\": " << maxStack_ << "\n}" << std::endl;
+}
+
+// write as JSON to a file
+bool cg::build_stats::write_json(const std::string & name) const {
+  std::ofstream out(name);
+  if ( !out ) {
+    std::cerr << "cg: can not open " << name << std::endl;
+    return false;
+  }
+  write_json(out);
+  return true;
+}
+
@@ -0,0 +1,163 @@
+
+
+#include "trace.h"
+
+#include <iostream>
+
+
+// open a trace file
+bool cg::step_recorder::open(const std::string & name) {
+  close();
+
+  out_.open(name,std::ios::binary);
+  if ( !out_ ) {
+    std::cerr << "cg: can not open " << name << std::endl;
+    return false;
+  }
+  const uint32_t vers = trace::version;
+  out_.write(trace::magic,sizeof(trace::magic));
+  out_.write(reinterpret_cast<const char *>(&vers),sizeof(vers));
+  open_ = true;
+  names_.clear();
+  return true;
+}
+
+// close the file
+void cg::step_recorder::close() {
+  if ( !open_ )
+    return;
+  end_event();
+  out_.close();
+  open_ = false;
+}
+
+// start an event
+void cg::step_recorder::start_event() {
+  end_event();
+  buf_.clear();
+  event_ = true;
+}
+
+// record a step
+void cg::step_recorder::record(const step_record & st) {
+  if ( !open_ )
+    return;
+  if ( !event_ )
+    start_event();
+
+  // the name of the process, once per file
+  if ( st.process >= names_.size() )
+    names_.resize(st.process+1U,false);
+  if ( !names_[st.process] ) {
+    buf_.put<uint8_t>(trace::nameItem);
+    buf_.put<uint16_t>(st.process);
+    buf_.put(process_names().name(st.process));
+    names_[st.process] = true;
+  }
+
+  buf_.put<uint8_t>(trace::stepItem);
+  buf_.put<int32_t>(st.track_id);
+  buf_.put<int32_t>(st.pdg);
+  buf_.put<uint8_t>(st.status);
+  buf_.put(st.pre_pos);
+  buf_.put(st.pre_mom);
+  buf_.put(st.post_pos);
+  buf_.put(st.post_mom);
+  buf_.put<uint16_t>(st.process);
+  buf_.put<double>(st.edep);
+  buf_.put<uint32_t>(st.secondaries.size());
+  for ( const step_secondary & sec : st.secondaries ) {
+    buf_.put<int32_t>(sec.pdg);
+    buf_.put(sec.mom);
+  }
+}
+
+// write the event
+void cg::step_recorder::end_event() {
+  if ( !open_ || !event_ )
+    return;
+  const uint64_t n = buf_.size();
+  out_.write(reinterpret_cast<const char *>(&n),sizeof(n));
+  out_.write(buf_.data(),n);
+  buf_.clear();
+  event_ = false;
+}
+
+
+// open a trace file
+bool cg::step_trace::open(const std::string & name) {
+  in_.close();
+  in_.clear();
+  names_.clear();
+
+  in_.open(name,std::ios::binary);
+  if ( !in_ ) {
+    std::cerr << "cg: can not open " << name << std::endl;
+    return false;
+  }
+  char mgc[4];
+  uint32_t vers = 0U;
+  in_.read(mgc,sizeof(mgc));
+  in_.read(reinterpret_cast<char *>(&vers),sizeof(vers));
+  if ( !in_ || std::memcmp(mgc,trace::magic,sizeof(mgc)) != 0 || vers > trace::version ) {
+    std::cerr << "cg: " << name << " is not a step trace" << std::endl;
+    in_.close();
+    return false;
+  }
+  return true;
+}
+
+// read an event
+bool cg::step_trace::next_event(std::vector<step_record> & steps) {
+  steps.clear();
+
+  uint64_t n = 0U;
+  if ( !in_.read(reinterpret_cast<char *>(&n),sizeof(n)) )
+    return false;
+  payload_.resize(n);
+  if ( !in_.read(payload_.data(),n) ) {
+    std::cerr << "cg: truncated step trace" << std::endl;
+    return false;
+  }
+
+  bin::ibuffer buf(payload_.data(),payload_.size());
+  buf.set_names(&names_);
+  std::string name;
+  while ( buf.good() && buf.tell() != payload_.size() ) {
+    const uint8_t kind = buf.get<uint8_t>();
+    if ( kind == trace::nameItem ) {
+      const uint16_t id = buf.get<uint16_t>();
+      buf.get(name);
+      if ( id >= names_.size() )
+        names_.resize(id+1U,0U);
+      names_[id] = process_names().intern(name);
+      continue;
+    }
+    if ( kind != trace::stepItem ) {
+      std::cerr << "cg: unknown item in step trace" << std::endl;
+      return false;
+    }
+
+    steps.emplace_back();
+    step_record & st = steps.back();
+    st.track_id = buf.get<int32_t>();
+    st.pdg = buf.get<int32_t>();
+    st.status = buf.get<uint8_t>();
+    buf.get(st.pre_pos);
+    buf.get(st.pre_mom);
+    buf.get(st.post_pos);
+    buf.get(st.post_mom);
+    st.process = buf.get_name();
+    st.edep = buf.get<double>();
+    const uint32_t nsec = buf.get<uint32_t>();
+    for ( uint32_t i=0; i != nsec && buf.good(); i++ ) {
+      step_secondary sec;
+      sec.pdg = buf.get<int32_t>();
+      buf.get(sec.mom);
+      st.secondaries.push_back(sec);
+    }
+  }
+
+  return buf.good();
+}
+
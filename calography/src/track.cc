@@ -3,37 +3,42 @@
 
 #include <iostream>
 
-// print
-void cg::track::print(int lvl) const {
+// print this node
+void cg::track::print_node(int lvl) const {
   std::cout << std::string(lvl,' ') << "Track "
     << id_ << " " << g4trackid_ << " pdg(" << pdgid_ << ") E = " << energy_
     << " X(" << pos_ << ")  P(" << momentum_ << ")" << std::endl;
-
-  const unsigned nkids = children_.size();
-  for ( unsigned i=0; i != nkids; i++ ) {
-    children_[i]->print(lvl+1);
-  }
 }
 
 
-// serialize
-void cg::track::serialize(std::ostream & stream) const { 
+// serialize the track fields
+void cg::track::serialize_fields(std::ostream & stream) const { 
   stream << id_ << " " << type_ << " " << pdgid_ << " " << g4trackid_ 
     << " " << energy_ << " " << pos_ << " " << momentum_ << " ";
-
-  const unsigned nkids = children_.size();
-  stream << nkids << " ";
-  for ( unsigned i=0; i != nkids; i++ ) {
-    children_[i]->serialize(stream);
-  }
 }
 
 
-// deserialize
-void cg::track::deserialize(std::istream & stream) {
+// deserialize the track fields
+void cg::track::deserialize_fields(std::istream & stream) {
   unsigned tmptype;
   stream >> id_ >> tmptype >> pdgid_ >> g4trackid_ >> energy_ >> pos_ >> momentum_;
   type_ = static_cast<cg::node_type>(tmptype);
+}
 
-  deserialize_children(stream);
+// write the track fields (binary)
+void cg::track::write_fields(bin::obuffer & buf) const {
+  node::write_fields(buf);
+  buf.put<int32_t>(pdgid_);
+  buf.put<uint32_t>(g4trackid_);
+  buf.put_momentum(momentum_);
 }
+
+
+// read the track fields (binary)
+void cg::track::read_fields(bin::ibuffer & buf) {
+  node::read_fields(buf);
+  pdgid_ = buf.get<int32_t>();
+  g4trackid_ = buf.get<uint32_t>();
+  buf.get_momentum(momentum_);
+}
+
@@ -0,0 +1,71 @@
+
+
+#include "trajectory.h"
+
+#include <iostream>
+#include <string>
+
+// print this node
+void cg::trajectory::print_node(int lvl) const {
+  std::cout << std::string(lvl,' ') << "Trajectory "
+    << id_ << " " << g4trackid_ << " pdg(" << pdgid_ << ") E = " << energy_
+    << " X(" << pos_ << ")  P(" << momentum_ << ") steps " << steps_.size() << std::endl;
+}
+
+
+// serialize the trajectory fields
+void cg::trajectory::serialize_fields(std::ostream & stream) const {
+  track::serialize_fields(stream);
+  stream << steps_.size() << " ";
+  for ( const step_point & pt : steps_ )
+    stream << pt.pos << " " << pt.energy << " " << process_names().name(pt.process) << " ";
+}
+
+
+// deserialize the trajectory fields
+void cg::trajectory::deserialize_fields(std::istream & stream) {
+  track::deserialize_fields(stream);
+
+  size_t n;
+  stream >> n;
+  steps_.clear();
+  steps_.reserve(n);
+  std::string name;
+  step_point pt;
+  for ( size_t i=0; i != n && stream.good(); i++ ) {
+    stream >> pt.pos >> pt.energy >> name;
+    pt.process = process_names().intern(name);
+    steps_.push_back(pt);
+  }
+}
+
+// write the trajectory fields (binary)
+void cg::trajectory::write_fields(bin::obuffer & buf) const {
+  track::write_fields(buf);
+  buf.put<uint32_t>(steps_.size());
+
+  // step points are relative to the trajectory position as it is read back
+  const relvec here = buf.coding().rounded(pos_,buf.origin());
+  for ( const step_point & pt : steps_ ) {
+    buf.put_pos(pt.pos,here);
+    buf.put<float>(pt.energy);
+    buf.put_name(pt.process);
+  }
+}
+
+
+// read the trajectory fields (binary)
+void cg::trajectory::read_fields(bin::ibuffer & buf) {
+  track::read_fields(buf);
+
+  const uint32_t n = buf.get<uint32_t>();
+  steps_.clear();
+  step_point pt;
+  for ( uint32_t i=0; i != n && buf.good(); i++ ) {
+    buf.get_pos(pt.pos,pos_);
+    pt.energy = buf.get<float>();
+    pt.process = buf.get_name();
+    steps_.push_back(pt);
+  }
+}
+
@@ -0,0 +1,40 @@
+
+
+#include "trigger.h"
+
+
+// add a trigger
+bool cg::event_selector::add_trigger(const std::string & name, const event_trigger & trig) {
+  if ( triggers_.size() == maxTriggers )
+    return false;
+  names_.push_back(name);
+  triggers_.push_back(trig);
+  return true;
+}
+
+// evaluate the triggers
+uint32_t cg::event_selector::evaluate(const node & root, const event_summary & summary) const {
+  uint32_t fired = 0U;
+  for ( size_t i=0; i != triggers_.size(); i++ )
+    if ( triggers_[i](root,summary) )
+      fired |= 1U << i;
+  return fired;
+}
+
+
+// write summaries
+void cg::write_summaries(std::ostream & out, const std::vector<event_summary> & summaries,
+    const std::vector<std::string> & triggers) {
+
+  // the header names the trigger bits
+  out << "# event thread pdg energy edep steps secondaries nodes tmax triggers recorded\n";
+  for ( size_t i=0; i != triggers.size(); i++ )
+    out << "# trigger " << i << " " << triggers[i] << "\n";
+
+  for ( const event_summary & sum : summaries )
+    out << sum.event << " " << sum.thread << " " << sum.primary_pdg << " " << sum.primary_energy
+      << " " << sum.edep << " " << sum.steps << " " << sum.secondaries << " " << sum.nodes
+      << " " << sum.tmax << " " << sum.triggers << " " << (sum.recorded ? 1 : 0) << "\n";
+  out.flush();
+}
+
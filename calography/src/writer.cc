@@ -0,0 +1,100 @@
+
+
+#include "writer.h"
+
+#include <sstream>
+#include <iostream>
+
+
+// open a file
+bool cg::collection_writer::open(const std::string & name, io_format fmt, compression comp,
+    const bin::vector_coding & coding) {
+
+  close();
+
+  fmt_ = fmt;
+  comp_ = fmt == binaryFormat ? comp : noCompression;
+  coding_ = fmt == binaryFormat ? coding : bin::vector_coding();
+  index_.clear();
+  names_.clear();
+  if ( fmt_ == binaryFormat ) {
+    out_.open(name,std::ios::binary);
+    bin::write_header(out_);
+    offset_ = bin::header_size+bin::write_coding(out_,coding_);
+  } else {
+    out_.open(name);
+    offset_ = 0U;
+  }
+
+  if ( !out_.is_open() ) {
+    std::cerr << "cg: can not open " << name << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+// close the file
+void cg::collection_writer::close() {
+  if ( !out_.is_open() )
+    return;
+
+  if ( fmt_ == binaryFormat )
+    bin::write_index(out_,index_,names_);
+
+  out_.close();
+  index_.clear();
+}
+
+// encode a graph
+bool cg::collection_writer::encode(const node * nd, io_format fmt, bin::obuffer & buf, compression comp,
+    const bin::vector_coding & coding) {
+  buf.clear();
+  if ( fmt == binaryFormat ) {
+    // the uncompressed record is kept per thread
+    static thread_local bin::obuffer raw;
+    if ( !bin::encode_event(nd,comp,coding,buf,raw) ) {
+      std::cerr << "cg: event could not be encoded, not written" << std::endl;
+      return false;
+    }
+  } else {
+    std::ostringstream str;
+    str << nd;
+    const std::string & rec = str.str();
+    buf.append(rec.data(),rec.size());
+  }
+  return true;
+}
+
+// append an encoded graph
+size_t cg::collection_writer::append(const bin::obuffer & buf) {
+  if ( !out_.is_open() || !buf.good() )
+    return 0U;
+
+  if ( fmt_ == binaryFormat ) {
+    // new names go ahead of the event
+    const uint64_t nbytes = bin::write_names(out_,buf.names(),names_);
+    offset_ += nbytes;
+
+    const uint32_t tag = comp_ == noCompression ? bin::eventTag : bin::compressedEventTag;
+    bin::write_chunk(out_,tag,buf.data(),buf.size());
+    offset_ += bin::chunk_header_size;
+    index_.push_back(std::make_pair(offset_,buf.size()));
+    offset_ += buf.size();
+    return nbytes+bin::chunk_header_size+buf.size();
+  }
+
+  out_.write(buf.data(),buf.size());
+  index_.push_back(std::make_pair(offset_,buf.size()));
+  offset_ += buf.size();
+  return buf.size();
+}
+
+// write a graph
+size_t cg::collection_writer::write(const node * nd) {
+  if ( !encode(nd,fmt_,buf_,comp_,coding_) )
+    return 0U;
+  return append(buf_);
+}
+
+
@@ -0,0 +1,82 @@
+/**
+* @file test_index.cc
+* @author C S Cowden
+* @brief Check the node index against the search of the graph, with
+* repeated ids and indexes built, dropped and merged.
+*/
+
+// --- includes ---
+#include <memory>
+
+#include "testing.h"
+
+namespace {
+
+// look up every node of a graph through an indexed node
+void check_find(cg::node * top) {
+  for ( const cg::node * nd : cgtest::preorder(top) ) {
+    cg::node * found = top->find(nd->id());
+    CG_CHECK(found && found->id() == nd->id());
+  }
+}
+
+}
+
+int main() {
+  std::mt19937 rng(11U);
+
+  // repeated ids: copies of leaves keep the id of the original
+  std::unique_ptr<cg::node> root(cgtest::random_graph(rng,200U));
+  const std::vector<const cg::node *> nodes = cgtest::preorder(root.get());
+  cg::node * sub = new cg::node(cg::genericNode,0.,cg::relvec(0.,0.,0.,0.));
+  root->add_child(sub);
+  std::vector<cg::node *> copies;
+  for ( size_t i=0; i < nodes.size(); i += 7U ) {
+    cg::node * leaf = new cg::node(cg::genericNode,1.,nodes[i]->pos());
+    const_cast<cg::node *>(nodes[i])->add_child(leaf);
+    cg::node * cp = new cg::node(*leaf);
+    sub->add_child(cp);
+    copies.push_back(cp);
+  }
+
+  root->build_index();
+  CG_CHECK(root->index() && root->index()->root() == root.get());
+  for ( cg::node * cp : copies ) {
+    CG_CHECK(cp->index() == root->index());
+    CG_CHECK(sub->find(cp->id()) == cp);
+  }
+  check_find(root.get());
+
+  // every node is detached, repeated ids included
+  root->drop_index();
+  for ( const cg::node * nd : cgtest::preorder(root.get()) )
+    CG_CHECK(nd->index() == NULL);
+  for ( cg::node * cp : copies )
+    cp->add_child(new cg::node(cg::genericNode,0.,cp->pos()));
+  check_find(root.get());
+
+  // rebuilt, and extended below the nodes of repeated ids
+  root->build_index();
+  for ( cg::node * cp : copies ) {
+    cg::node * leaf = new cg::node(cg::genericNode,0.,cg::relvec(0.,0.,0.,0.));
+    cp->add_child(leaf);
+    CG_CHECK(leaf->index() == root->index());
+    CG_CHECK(root->find(leaf->id()) == leaf);
+  }
+  root->drop_index();
+  for ( const cg::node * nd : cgtest::preorder(root.get()) )
+    CG_CHECK(nd->index() == NULL);
+
+  // a graph with its own index added to an indexed graph
+  root->build_index();
+  cg::node * other = cgtest::random_graph(rng,50U);
+  other->build_index();
+  root->add_child(other);
+  CG_CHECK(other->index() == root->index());
+  check_find(other);
+  root->drop_index();
+  for ( const cg::node * nd : cgtest::preorder(root.get()) )
+    CG_CHECK(nd->index() == NULL);
+
+  return cgtest::result("test_index");
+}
@@ -0,0 +1,171 @@
+/**
+* @file test_mapped.cc
+* @author C S Cowden
+* @brief Check the partial and parallel extraction of mapped graphs, and
+* the walk of records without a stored length, against extract() and
+* ReadCollection().
+*/
+
+// --- includes ---
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#include "testing.h"
+#include "mapped.h"
+
+namespace {
+
+const char * file = "test_mapped.cgb";
+const cgtest::tolerance exact = {0.,0.,false};
+
+// the nodes kept by extract_if() in these tests
+bool keep_id(cg::node_id id, unsigned depth) { return depth < 2U || id%4U != 0U; }
+
+/**
+* @brief compare a partial graph with a full one: the children of a node
+* at maxDepth are not built, nor those rejected by keep_id (if pruned)
+*/
+bool same_partial(const cg::node * full, const cg::node * part, unsigned depth, unsigned maxDepth, bool pruned) {
+  if ( !cgtest::same_node(full,part,exact) )
+    return false;
+  std::vector<const cg::node *> kids;
+  if ( depth < maxDepth )
+    for ( const cg::node * nd : full->children() )
+      if ( !pruned || keep_id(nd->id(),depth+1U) )
+        kids.push_back(nd);
+  if ( kids.size() != part->children().size() )
+    return false;
+  for ( size_t k=0; k != kids.size(); k++ )
+    if ( !same_partial(kids[k],part->children()[k],depth+1U,maxDepth,pruned) )
+      return false;
+  return true;
+}
+
+// check the children of every view against the graph
+bool same_children(const cg::node_view & nv, const cg::node * nd) {
+  if ( nv.children().size() != nd->children().size() )
+    return false;
+  size_t k = 0U;
+  for ( const cg::node_view & child : nv.children() ) {
+    if ( k == nd->children().size() || child.id() != nd->children()[k]->id()
+        || !same_children(child,nd->children()[k]) )
+      return false;
+    k++;
+  }
+  return k == nd->children().size();
+}
+
+// expand a lazy graph completely, one generation at a time
+void expand_all(cg::lazy_graph & lg) {
+  std::vector<cg::node *> stack(1U,lg.root());
+  while ( !stack.empty() ) {
+    cg::node * nd = stack.back();
+    stack.pop_back();
+    if ( !lg.expanded(nd) )
+      lg.expand(nd);
+    CG_CHECK(lg.expanded(nd));
+    for ( cg::node * child : nd->children() )
+      stack.push_back(child);
+  }
+}
+
+// check every way to extract a view against a graph read before
+void check_view(const cg::node_view & nv, const cg::node * rd) {
+  std::unique_ptr<cg::node> full(nv.extract());
+  CG_CHECK(cgtest::same_graph(rd,full.get(),exact));
+  CG_CHECK(same_children(nv,rd));
+
+  for ( unsigned depth=0U; depth != 4U; depth++ ) {
+    std::unique_ptr<cg::node> part(nv.extract(depth));
+    CG_CHECK(same_partial(rd,part.get(),0U,depth,false));
+  }
+
+  std::unique_ptr<cg::node> pruned(nv.extract_if([](const cg::node_view & v, unsigned depth) {
+    return keep_id(v.id(),depth);
+  }));
+  CG_CHECK(same_partial(rd,pruned.get(),0U,~0U,true));
+
+  for ( unsigned nthreads : { 1U, 2U, 4U } ) {
+    std::unique_ptr<cg::node> par(nv.extract_parallel(nthreads));
+    CG_CHECK(cgtest::same_graph(rd,par.get(),exact));
+  }
+
+  cg::lazy_graph lg(nv,2U);
+  CG_CHECK(same_partial(rd,lg.root(),0U,2U,false));
+  expand_all(lg);
+  CG_CHECK(cgtest::same_graph(rd,lg.root(),exact));
+}
+
+/**
+* @brief mark the child records of every node of an event as of unknown
+* length, as for graphs too large for the u32 length
+*/
+void forget_lengths(std::vector<char> & rec) {
+  size_t p = 0U;
+  while ( p+5U <= rec.size() ) {
+    uint32_t flen;
+    std::memcpy(&flen,&rec[p+1],sizeof(flen));
+    std::memcpy(&rec[p+5+flen+4],&cg::bin::unknownLength,sizeof(uint32_t));
+    p += 5U+flen+8U;
+  }
+  CG_CHECK(p == rec.size());
+}
+
+}
+
+int main() {
+  std::mt19937 rng(99U);
+  cg::node_collection nc;
+  for ( unsigned i=0; i != 6U; i++ )
+    nc.push_back(cgtest::random_graph(rng,1U+rng()%3000U));
+
+  const cg::bin::vector_coding codings[] = {
+    cg::bin::vector_coding(),
+    cg::bin::vector_coding(cg::bin::floatDeltas),
+    cg::bin::vector_coding::fixed_point(1000.,100.,24U)
+  };
+  for ( const cg::bin::vector_coding & coding : codings ) {
+    for ( cg::compression comp : { cg::noCompression, cg::fastCompression } ) {
+      CG_CHECK(cg::WriteCollection(nc,file,cg::binaryFormat,comp,coding));
+      cg::node_collection rc = cg::ReadCollection(file,cg::binaryFormat);
+      CG_CHECK(rc.size() == nc.size());
+
+      cg::mapped_collection mc(file);
+      CG_CHECK(mc.size() == rc.size());
+      for ( size_t i=0; i != mc.size() && i != rc.size(); i++ )
+        check_view(mc[i],rc[i]);
+
+      cg::node_collection ec = mc.extract(3U);
+      CG_CHECK(ec.size() == rc.size());
+      for ( size_t i=0; i != ec.size() && i != rc.size(); i++ )
+        CG_CHECK(cgtest::same_graph(rc[i],ec[i],exact));
+
+      for ( cg::node * nd : ec )
+        delete nd;
+      for ( cg::node * nd : rc )
+        delete nd;
+    }
+
+    // records without the length of their children are walked
+    cg::record_layout layout;
+    layout.set_coding(coding);
+    for ( const cg::node * nd : nc ) {
+      cg::bin::obuffer buf, scratch;
+      CG_CHECK(cg::bin::encode_event(nd,cg::noCompression,coding,buf,scratch) != 0U);
+      std::vector<char> rec(buf.data(),buf.data()+buf.size());
+      const cg::node_view known(rec.data(),rec.data()+rec.size(),&layout);
+      std::unique_ptr<cg::node> rd(known.extract());
+
+      forget_lengths(rec);
+      const cg::node_view nv(rec.data(),rec.data()+rec.size(),&layout);
+      CG_CHECK(nv.subgraph_size() == rec.size());
+      check_view(nv,rd.get());
+    }
+  }
+
+  for ( cg::node * nd : nc )
+    delete nd;
+  std::remove(file);
+  return cgtest::result("test_mapped");
+}
@@ -0,0 +1,203 @@
+/**
+* @file test_roundtrip.cc
+* @author C S Cowden
+* @brief Write collections in each vector coding, with and without
+* compression, and check what the readers get back.
+*/
+
+// --- includes ---
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+
+#include "testing.h"
+#include "mapped.h"
+#include "writer.h"
+
+namespace {
+
+const double extent = 1000.;
+const double duration = 100.;
+const char * file = "test_roundtrip.cgb";
+
+// tolerance of a coding over the generated graphs
+cgtest::tolerance tolerance_of(const cg::bin::vector_coding & coding) {
+  switch ( coding.mode ) {
+    case cg::bin::floatDeltas:
+      // f32 deltas between nodes at most 2*extent apart
+      return cgtest::tolerance{std::ldexp(extent,-21),std::ldexp(duration,-21),true};
+    case cg::bin::fixedDeltas:
+      return cgtest::tolerance{coding.space*(.5+1e-6),coding.time*(.5+1e-6),true};
+    default:
+      return cgtest::tolerance{0.,0.,false};
+  }
+}
+
+void free_collection(cg::node_collection & nc) {
+  for ( cg::node * nd : nc )
+    delete nd;
+  nc.clear();
+}
+
+// check if the file holds a string
+bool file_contains(const std::string & str) {
+  std::ifstream in(file,std::ios::binary);
+  const std::string data((std::istreambuf_iterator<char>(in)),std::istreambuf_iterator<char>());
+  return data.find(str) != std::string::npos;
+}
+
+// write, read back in every way and compare
+void roundtrip(const cg::node_collection & nc, cg::compression comp, const cg::bin::vector_coding & coding) {
+  const cgtest::tolerance tol = tolerance_of(coding);
+  CG_CHECK(cg::WriteCollection(nc,file,cg::binaryFormat,comp,coding));
+  CG_CHECK(!file_contains("unused_"));
+
+  // by the index, with the names which follow it
+  for ( size_t i=0; i != nc.size(); i++ ) {
+    std::unique_ptr<cg::node> nd(cg::ReadGraph(file,i));
+    CG_CHECK(cgtest::same_graph(nc[i],nd.get(),tol));
+  }
+
+  cg::node_collection rc = cg::ReadCollection(file,cg::binaryFormat);
+  CG_CHECK(rc.size() == nc.size());
+  for ( size_t i=0; i != rc.size() && i != nc.size(); i++ )
+    CG_CHECK(cgtest::same_graph(nc[i],rc[i],tol));
+  free_collection(rc);
+
+  cg::mapped_collection mc(file);
+  CG_CHECK(mc.is_open());
+  CG_CHECK(mc.size() == nc.size());
+  for ( size_t i=0; i != mc.size() && i != nc.size(); i++ ) {
+    CG_CHECK(mc.compressed(i) == (comp != cg::noCompression));
+    CG_CHECK(cgtest::same_views(mc[i],nc[i],tol));
+    std::unique_ptr<cg::node> nd(mc[i].extract());
+    CG_CHECK(cgtest::same_graph(nc[i],nd.get(),tol));
+  }
+}
+
+// an event out of the range of the fixed-point coding is not written
+void out_of_range(cg::compression comp) {
+  const cg::bin::vector_coding coding = cg::bin::vector_coding::fixed_point(5000.,1000.,24U);
+  const cgtest::tolerance tol = tolerance_of(coding);
+
+  std::mt19937 rng(7U);
+  cg::node_collection nc;
+  nc.push_back(cgtest::random_graph(rng,50U,extent,duration));
+  nc.push_back(cgtest::random_graph(rng,50U,extent,duration));
+  nc.push_back(cgtest::random_graph(rng,50U,extent,duration));
+  // a time far beyond the duration (2^31 quanta of 6e-5 ns are 1.3e5 ns)
+  nc[1]->children()[0]->add_child(new cg::process("Decay",0.,cg::relvec(3e6,0.,0.,0.)));
+
+  CG_CHECK(!cg::WriteCollection(nc,file,cg::binaryFormat,comp,coding));
+  cg::node_collection rc = cg::ReadCollection(file,cg::binaryFormat);
+  CG_CHECK(rc.size() == 2U);
+  if ( rc.size() == 2U ) {
+    CG_CHECK(cgtest::same_graph(nc[0],rc[0],tol));
+    CG_CHECK(cgtest::same_graph(nc[2],rc[1],tol));
+  }
+  free_collection(rc);
+
+  {
+    cg::mapped_collection mc(file);
+    CG_CHECK(mc.size() == 2U);
+    if ( mc.size() == 2U ) {
+      CG_CHECK(cgtest::same_views(mc[0],nc[0],tol));
+      CG_CHECK(cgtest::same_views(mc[1],nc[2],tol));
+    }
+  }
+
+  // the streaming writer refuses the event
+  {
+    cg::collection_writer writer(file,cg::binaryFormat,comp,coding);
+    CG_CHECK(writer.write(nc[0]) != 0U);
+    CG_CHECK(writer.write(nc[1]) == 0U);
+    CG_CHECK(writer.write(nc[2]) != 0U);
+  }
+  CG_CHECK(!file_contains("unused_"));
+  rc = cg::ReadCollection(file,cg::binaryFormat);
+  CG_CHECK(rc.size() == 2U);
+  free_collection(rc);
+
+  free_collection(nc);
+}
+
+// a corrupt chunk length is refused rather than allocated
+void corrupt_length(const cg::node_collection & nc) {
+  CG_CHECK(cg::WriteCollection(nc,file,cg::binaryFormat,cg::noCompression));
+  {
+    // the length of the first event chunk
+    std::fstream io(file,std::ios::binary|std::ios::in|std::ios::out);
+    cg::bin::event_index index;
+    CG_CHECK(cg::bin::read_index(io,index) && !index.empty());
+    if ( index.empty() )
+      return;
+    const uint64_t len = uint64_t(1U) << 60;
+    io.clear();
+    io.seekp(index[0].first-sizeof(len));
+    io.write(reinterpret_cast<const char *>(&len),sizeof(len));
+  }
+  std::unique_ptr<cg::node> nd(cg::ReadGraph(file,0U));
+  CG_CHECK(!nd);
+  cg::node_collection rc = cg::ReadCollection(file,cg::binaryFormat);
+  CG_CHECK(rc.empty());
+  free_collection(rc);
+}
+
+// a corrupt uncompressed size is refused rather than allocated
+void corrupt_size(const cg::node_collection & nc) {
+  CG_CHECK(cg::WriteCollection(nc,file,cg::binaryFormat,cg::fastCompression));
+  {
+    // the size in the header of the first event payload
+    std::fstream io(file,std::ios::binary|std::ios::in|std::ios::out);
+    cg::bin::event_index index;
+    CG_CHECK(cg::bin::read_index(io,index) && !index.empty());
+    if ( index.empty() )
+      return;
+    const uint64_t size = uint64_t(1U) << 60;
+    io.clear();
+    io.seekp(index[0].first+sizeof(uint8_t));
+    io.write(reinterpret_cast<const char *>(&size),sizeof(size));
+  }
+  std::unique_ptr<cg::node> nd(cg::ReadGraph(file,0U));
+  CG_CHECK(!nd);
+  cg::node_collection rc = cg::ReadCollection(file,cg::binaryFormat);
+  CG_CHECK(rc.empty());
+  free_collection(rc);
+}
+
+}
+
+int main() {
+  // only the names used by the events are written (the ids used are
+  // not consecutive, so the names are written in several chunks)
+  for ( const char * name : { "eIoni", "eBrem", "compt", "hadInelastic", "nCapture" } ) {
+    cg::process_names().intern(name);
+    cg::process_names().intern(std::string("unused_")+name);
+  }
+
+  std::mt19937 rng(2024U);
+  cg::node_collection nc;
+  for ( unsigned i=0; i != 8U; i++ )
+    nc.push_back(cgtest::random_graph(rng,1U+rng()%500U,extent,duration));
+
+  const cg::bin::vector_coding codings[] = {
+    cg::bin::vector_coding(),
+    cg::bin::vector_coding(cg::bin::floatDeltas),
+    cg::bin::vector_coding::fixed_point(extent,duration,20U),
+    cg::bin::vector_coding::fixed_point(extent,duration,29U)
+  };
+  for ( const cg::bin::vector_coding & coding : codings ) {
+    roundtrip(nc,cg::noCompression,coding);
+    roundtrip(nc,cg::fastCompression,coding);
+  }
+  corrupt_length(nc);
+  corrupt_size(nc);
+  free_collection(nc);
+
+  out_of_range(cg::noCompression);
+  out_of_range(cg::fastCompression);
+
+  std::remove(file);
+  return cgtest::result("test_roundtrip");
+}
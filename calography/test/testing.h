@@ -0,0 +1,194 @@
+#ifndef TESTING_H
+#define TESTING_H
+
+/**
+* @file testing.h
+* @author C S Cowden
+* @brief Checks and graph generation shared by the self-checking tests.
+*/
+
+// --- includes ---
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <cmath>
+
+#include "CaloGraphy.h"
+
+namespace cgtest {
+
+// number of failed checks
+inline unsigned & failures() {
+  static unsigned n = 0U;
+  return n;
+}
+
+// check a condition, report it if it fails
+#define CG_CHECK(cond) \
+  do { if ( !(cond) ) { cgtest::failures()++; \
+    std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl; } } while ( 0 )
+
+// report the result of a test program
+inline int result(const char * name) {
+  if ( failures() ) {
+    std::cerr << name << ": " << failures() << " failed checks" << std::endl;
+    return 1;
+  }
+  std::cout << name << ": ok" << std::endl;
+  return 0;
+}
+
+
+/**
+* @brief generate a random graph with every node type
+* @param[in] n approximate number of nodes
+* @param[in] extent largest absolute coordinate (mm)
+* @param[in] duration largest time (ns)
+*/
+inline cg::node * random_graph(std::mt19937 & rng, size_t n, double extent=1000., double duration=100.) {
+  static const char * procs[] = { "eIoni", "eBrem", "compt", "hadInelastic", "nCapture" };
+  static const int pdgs[] = { 11, -11, 22, 111, 211, 2112 };
+  std::uniform_real_distribution<double> uni(0.,1.);
+  auto position = [&]() {
+    return cg::relvec(duration*uni(rng),extent*(2.*uni(rng)-1.),extent*(2.*uni(rng)-1.),extent*(2.*uni(rng)-1.));
+  };
+  auto momentum = [&]() {
+    return cg::relvec(1e3*uni(rng),uni(rng)-.5,uni(rng)-.5,uni(rng)-.5);
+  };
+
+  unsigned g4id = 1U;
+  cg::node * root = new cg::track(211,g4id,momentum(),uni(rng),position());
+  std::vector<cg::node *> nodes(1U,root);
+  while ( nodes.size() < n ) {
+    cg::node * parent = nodes[rng()%nodes.size()];
+    cg::node * nd;
+    if ( parent->type() != cg::processNode ) {
+      nd = new cg::process(procs[rng()%5U],uni(rng),position());
+    } else if ( uni(rng) < 0.1 ) {
+      nd = new cg::node(cg::genericNode,uni(rng),position());
+    } else if ( uni(rng) < 0.3 ) {
+      cg::trajectory * trj = new cg::trajectory(pdgs[rng()%6U],++g4id,momentum(),uni(rng),position());
+      for ( unsigned k=rng()%5U; k != 0U; k-- )
+        trj->add_step(position(),uni(rng),cg::process_names().intern(procs[rng()%5U]));
+      nd = trj;
+    } else {
+      nd = new cg::track(pdgs[rng()%6U],++g4id,momentum(),uni(rng),position());
+    }
+    parent->add_child(nd);
+    nodes.push_back(nd);
+  }
+  return root;
+}
+
+/**
+* @brief the nodes of a graph in depth-first (pre-)order
+*/
+inline std::vector<const cg::node *> preorder(const cg::node * root) {
+  std::vector<const cg::node *> nodes;
+  std::vector<const cg::node *> stack(1U,root);
+  while ( !stack.empty() ) {
+    const cg::node * nd = stack.back();
+    stack.pop_back();
+    nodes.push_back(nd);
+    const cg::node_list & kids = nd->children();
+    for ( size_t k=kids.size(); k != 0U; k-- )
+      stack.push_back(kids[k-1U]);
+  }
+  return nodes;
+}
+
+/**
+* @brief tolerance of the positions read back
+*/
+struct tolerance {
+  double space;
+  double time;
+  bool float_momentum;   // momenta stored as f32
+};
+
+// compare positions within a tolerance
+inline bool near(const cg::relvec & a, const cg::relvec & b, const tolerance & tol) {
+  return std::fabs(a.t_-b.t_) <= tol.time && std::fabs(a.x_-b.x_) <= tol.space
+    && std::fabs(a.y_-b.y_) <= tol.space && std::fabs(a.z_-b.z_) <= tol.space;
+}
+
+// compare momenta
+inline bool same_momentum(const cg::relvec & a, const cg::relvec & b, bool f32) {
+  if ( f32 )
+    return float(a.t_) == float(b.t_) && float(a.x_) == float(b.x_)
+      && float(a.y_) == float(b.y_) && float(a.z_) == float(b.z_);
+  return a.t_ == b.t_ && a.x_ == b.x_ && a.y_ == b.y_ && a.z_ == b.z_;
+}
+
+/**
+* @brief check that a node read back matches the written one (not its children)
+*/
+inline bool same_node(const cg::node * a, const cg::node * b, const tolerance & tol) {
+  if ( !a || !b || a->type() != b->type() || a->id() != b->id() || a->energy() != b->energy()
+      || !near(a->pos(),b->pos(),tol) )
+    return false;
+
+  if ( cg::track::is_track(a->type()) ) {
+    const cg::track * ta = static_cast<const cg::track *>(a);
+    const cg::track * tb = static_cast<const cg::track *>(b);
+    if ( ta->pdg() != tb->pdg() || ta->G4TrackID() != tb->G4TrackID()
+        || !same_momentum(ta->momentum(),tb->momentum(),tol.float_momentum) )
+      return false;
+  }
+  if ( a->type() == cg::processNode
+      && static_cast<const cg::process *>(a)->name() != static_cast<const cg::process *>(b)->name() )
+    return false;
+  if ( a->type() == cg::trajectoryNode ) {
+    const cg::step_list & sa = static_cast<const cg::trajectory *>(a)->steps();
+    const cg::step_list & sb = static_cast<const cg::trajectory *>(b)->steps();
+    if ( sa.size() != sb.size() )
+      return false;
+    for ( size_t k=0; k != sa.size(); k++ )
+      if ( !near(sa[k].pos,sb[k].pos,tol) || sa[k].energy != sb[k].energy || sa[k].process != sb[k].process )
+        return false;
+  }
+  return true;
+}
+
+/**
+* @brief check that a graph read back matches the written one
+* @return false at the first difference
+*/
+inline bool same_graph(const cg::node * a, const cg::node * b, const tolerance & tol) {
+  if ( !same_node(a,b,tol) || a->children().size() != b->children().size() )
+    return false;
+  for ( size_t k=0; k != a->children().size(); k++ )
+    if ( !same_graph(a->children()[k],b->children()[k],tol) )
+      return false;
+  return true;
+}
+
+/**
+* @brief check the views of a mapped graph against the written graph
+*/
+inline bool same_views(const cg::node_view & root, const cg::node * nd, const tolerance & tol) {
+  const std::vector<const cg::node *> nodes = preorder(nd);
+  size_t i = 0U;
+  for ( const cg::node_view & nv : root.subgraph() ) {
+    if ( i == nodes.size() )
+      return false;
+    const cg::node * a = nodes[i++];
+    if ( nv.type() != a->type() || nv.id() != a->id() || nv.energy() != a->energy()
+        || !near(nv.pos(),a->pos(),tol) || nv.nchildren() != a->children().size() )
+      return false;
+    if ( a->type() == cg::trajectoryNode ) {
+      const cg::step_list & steps = static_cast<const cg::trajectory *>(a)->steps();
+      if ( nv.nsteps() != steps.size() )
+        return false;
+      for ( unsigned k=0; k != steps.size(); k++ )
+        if ( !near(nv.step(k).pos,steps[k].pos,tol) || nv.step(k).process != steps[k].process )
+          return false;
+    }
+  }
+  return i == nodes.size();
+}
+
+}
+
+#endif
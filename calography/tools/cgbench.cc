@@ -0,0 +1,460 @@
+
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include <sys/resource.h>
+
+#include "CaloGraphy.h"
+
+
+// generator and benchmark settings
+struct bench_config {
+  unsigned events = 10U;           // number of events
+  unsigned depth = 10U;            // maximum generation of secondaries
+  double steps = 20.;              // mean number of steps of a track
+  double branch = 0.05;            // probability that a step produces secondaries
+  double secondaries = 2.;         // mean number of secondaries of a branching step
+  double trajectories = 0.;        // fraction of tracks recorded as trajectories
+  size_t max_nodes = 200000U;      // limit on the nodes of an event
+  unsigned seed = 1U;              // random seed
+  unsigned repeat = 3U;            // repetitions of each benchmark
+  unsigned lookups = 100000U;      // indexed lookups per event
+  unsigned threads = 0U;           // threads of the parallel read and loops (0: hardware)
+  bool pooled = false;             // allocate the events from an arena
+  std::string formats = "binary,text,zlib";
+  std::string file = "cgbench_tmp";
+  std::string out;                 // JSON output file (stdout if empty)
+};
+
+// one benchmark result
+struct bench_result {
+  std::string name;
+  double best;       // fastest repetition (s)
+  double mean;       // mean of the repetitions (s)
+  uint64_t items;    // items (nodes, lookups) per repetition
+  uint64_t bytes;    // bytes per repetition (0 if not applicable)
+};
+
+
+// seconds since an arbitrary start
+double now() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// peak resident memory (kB)
+long peak_rss() {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF,&ru);
+  return ru.ru_maxrss;
+}
+
+
+// generate one synthetic shower
+// Each track takes a geometric number of steps; a step ends in a process
+// (a process node followed by the continuing track node, or a step point
+// of a trajectory) and may produce secondaries, which are followed down to
+// the maximum generation.
+cg::node * generate(const bench_config & cfg, std::mt19937_64 & rng, size_t & nnodes) {
+  static const char * procs[] = { "eIoni", "eBrem", "msc", "compt", "phot", "conv", "hadElastic", "Transportation" };
+  static const int pdgs[] = { 11, -11, 22, 211, 2112 };
+
+  std::uniform_real_distribution<double> uni(0.,1.);
+  std::normal_distribution<double> gauss(0.,1.);
+  std::geometric_distribution<unsigned> nsteps(1./std::max(cfg.steps,1.));
+  std::poisson_distribution<unsigned> nsec(std::max(cfg.secondaries,1e-6));
+
+  unsigned g4id = 1U;
+  auto new_track = [&](int pdg, const cg::relvec & mom, const cg::relvec & pos) -> cg::track * {
+    nnodes++;
+    if ( uni(rng) < cfg.trajectories )
+      return new cg::trajectory(pdg,g4id,mom,0.,pos);
+    return new cg::track(pdg,g4id,mom,0.,pos);
+  };
+
+  struct pending {
+    cg::track * trk;
+    unsigned depth;
+  };
+
+  nnodes = 0U;
+  cg::track * root = new_track(211,cg::relvec(1e4,0.,0.,1e4),cg::relvec(0.,0.,0.,0.));
+  std::vector<pending> stack(1U,pending{root,0U});
+
+  while ( !stack.empty() ) {
+    cg::track * trk = stack.back().trk;
+    const unsigned depth = stack.back().depth;
+    stack.pop_back();
+
+    const bool trj = trk->type() == cg::trajectoryNode;
+    const unsigned id = trk->G4TrackID();
+    cg::relvec pos = trk->pos();
+    const unsigned n = nsteps(rng)+1U;
+    double edep = 0.;
+
+    for ( unsigned s=0; s != n && nnodes < cfg.max_nodes; s++ ) {
+      pos = pos + cg::relvec(0.01*uni(rng),gauss(rng),gauss(rng),uni(rng)*2.);
+      const double dep = uni(rng);
+      const cg::name_id proc = cg::process_names().intern(procs[rng()%8U]);
+      const bool branching = depth < cfg.depth && uni(rng) < cfg.branch;
+      const bool last = s+1U == n;
+
+      // the step (the continuing track node carries the following deposits)
+      edep += dep;
+      trk->set_energy(edep);
+      cg::process * pnd = NULL;
+      if ( trj ) {
+        static_cast<cg::trajectory *>(trk)->add_step(pos,dep,proc);
+      } else {
+        pnd = new cg::process(proc,0.,pos);
+        trk->add_child(pnd);
+        nnodes++;
+      }
+
+      // secondaries
+      if ( branching ) {
+        if ( !pnd ) {
+          pnd = new cg::process(proc,0.,pos);
+          trk->add_child(pnd);
+          nnodes++;
+        }
+        const unsigned k = std::max(nsec(rng),1U);
+        for ( unsigned i=0; i != k; i++ ) {
+          g4id++;
+          cg::track * sec = new_track(pdgs[rng()%5U],cg::relvec(10.,gauss(rng),gauss(rng),gauss(rng)),pos);
+          pnd->add_child(sec);
+          stack.push_back(pending{sec,depth+1U});
+        }
+      }
+
+      if ( !trj && !last ) {
+        cg::track * next = new cg::track(trk->pdg(),id,trk->momentum(),0.,pos);
+        pnd->add_child(next);
+        nnodes++;
+        trk = next;
+        edep = 0.;
+      }
+    }
+  }
+
+  return root;
+}
+
+
+// time a benchmark
+bench_result measure(const std::string & name, unsigned repeat, uint64_t items, uint64_t bytes,
+    const std::function<void()> & fn) {
+  bench_result res{name,0.,0.,items,bytes};
+  for ( unsigned r=0; r != std::max(repeat,1U); r++ ) {
+    const double t0 = now();
+    fn();
+    const double dt = now()-t0;
+    res.best = r == 0U ? dt : std::min(res.best,dt);
+    res.mean += dt;
+  }
+  res.mean /= std::max(repeat,1U);
+  return res;
+}
+
+
+// visitor summing the energy of a graph
+struct energy_sum : public cg::visitor {
+  template<typename N>
+  cg::visit_action pre(const N & nd, unsigned) {
+    energy += nd.energy();
+    count++;
+    return cg::visitContinue;
+  }
+
+  double energy = 0.;
+  uint64_t count = 0U;
+};
+
+
+// size of a file
+uint64_t file_size(const std::string & name) {
+  std::ifstream in(name,std::ios::binary|std::ios::ate);
+  return in ? uint64_t(in.tellg()) : 0U;
+}
+
+// delete a collection
+void release(cg::node_collection & nc) {
+  for ( cg::node * nd : nc )
+    delete nd;
+  nc.clear();
+}
+
+
+// parse name=value arguments
+bool parse(int argc, char ** argv, bench_config & cfg) {
+  for ( int i=1; i != argc; i++ ) {
+    std::string arg(argv[i]);
+    if ( arg.compare(0,2,"--") == 0 )
+      arg.erase(0,2);
+    const size_t eq = arg.find('=');
+    if ( eq == std::string::npos )
+      return false;
+    const std::string key = arg.substr(0,eq);
+    const std::string val = arg.substr(eq+1U);
+
+    if ( key == "events" ) cfg.events = std::stoul(val);
+    else if ( key == "depth" ) cfg.depth = std::stoul(val);
+    else if ( key == "steps" ) cfg.steps = std::stod(val);
+    else if ( key == "branch" ) cfg.branch = std::stod(val);
+    else if ( key == "secondaries" ) cfg.secondaries = std::stod(val);
+    else if ( key == "trajectories" ) cfg.trajectories = std::stod(val);
+    else if ( key == "max-nodes" ) cfg.max_nodes = std::stoull(val);
+    else if ( key == "seed" ) cfg.seed = std::stoul(val);
+    else if ( key == "repeat" ) cfg.repeat = std::stoul(val);
+    else if ( key == "lookups" ) cfg.lookups = std::stoul(val);
+    else if ( key == "threads" ) cfg.threads = std::stoul(val);
+    else if ( key == "pooled" ) cfg.pooled = std::stoul(val) != 0U;
+    else if ( key == "formats" ) cfg.formats = val;
+    else if ( key == "file" ) cfg.file = val;
+    else if ( key == "out" ) cfg.out = val;
+    else return false;
+  }
+  return true;
+}
+
+// print the results as JSON
+void write_json(std::ostream & out, const bench_config & cfg, const std::map<std::string,double> & stats,
+    const std::vector<bench_result> & results) {
+  out.precision(6);
+  out << "{\n  \"config\": {"
+    << " \"events\": " << cfg.events << ", \"depth\": " << cfg.depth
+    << ", \"steps\": " << cfg.steps << ", \"branch\": " << cfg.branch
+    << ", \"secondaries\": " << cfg.secondaries << ", \"trajectories\": " << cfg.trajectories
+    << ", \"max_nodes\": " << cfg.max_nodes << ", \"seed\": " << cfg.seed
+    << ", \"repeat\": " << cfg.repeat << ", \"pooled\": " << (cfg.pooled ? "true" : "false")
+    << ", \"formats\": \"" << cfg.formats << "\" },\n";
+
+  out << "  \"stats\": {";
+  bool first = true;
+  for ( const auto & st : stats ) {
+    out << (first ? " " : ", ") << "\"" << st.first << "\": " << st.second;
+    first = false;
+  }
+  out << " },\n";
+
+  out << "  \"results\": [\n";
+  for ( size_t i=0; i != results.size(); i++ ) {
+    const bench_result & res = results[i];
+    out << "    { \"name\": \"" << res.name << "\", \"best_s\": " << res.best
+      << ", \"mean_s\": " << res.mean << ", \"items\": " << res.items
+      << ", \"items_per_s\": " << (res.best > 0. ? res.items/res.best : 0.)
+      << ", \"bytes\": " << res.bytes
+      << ", \"mb_per_s\": " << (res.best > 0. ? res.bytes/res.best/1e6 : 0.) << " }"
+      << (i+1U != results.size() ? "," : "") << "\n";
+  }
+  out << "  ]\n}" << std::endl;
+}
+
+
+int main(int argc, char **argv) {
+
+  bench_config cfg;
+  if ( !parse(argc,argv,cfg) ) {
+    std::cout << "cgbench [events=N] [depth=N] [steps=X] [branch=P] [secondaries=X] [trajectories=F]\n"
+      << "        [max-nodes=N] [seed=N] [repeat=N] [lookups=N] [threads=N] [pooled=0|1]\n"
+      << "        [formats=binary,text,zlib] [file=NAME] [out=FILE.json]" << std::endl;
+    return 1;
+  }
+
+  std::vector<bench_result> results;
+  std::map<std::string,double> stats;
+
+  // generate the events (in an arena if pooled, to measure memory either way)
+  cg::arena pool;
+  cg::node_collection events;
+  uint64_t nodes = 0U;
+  {
+    std::mt19937_64 rng(cfg.seed);
+    cg::arena::scope s(&pool);
+    const double t0 = now();
+    for ( unsigned e=0; e != cfg.events; e++ ) {
+      size_t n;
+      events.push_back(generate(cfg,rng,n));
+      nodes += n;
+    }
+    results.push_back(bench_result{"generate",now()-t0,now()-t0,nodes,0U});
+  }
+  stats["nodes"] = nodes;
+  stats["arena_bytes_per_node"] = nodes ? double(pool.used())/nodes : 0.;
+
+  // heap allocated copies unless pooled
+  if ( !cfg.pooled ) {
+    cg::WriteCollection(events,cfg.file+".cg",cg::binaryFormat);
+    events = cg::ReadCollection(cfg.file+".cg");
+    pool.release();
+  }
+
+  // traversal
+  results.push_back(measure("traverse",cfg.repeat,nodes,0U,[&]() {
+    energy_sum sum;
+    for ( const cg::node * nd : events )
+      cg::traverse(nd,sum);
+  }));
+
+  // shower extraction
+  results.push_back(measure("shower",cfg.repeat,nodes,0U,[&]() {
+    size_t n = 0U;
+    for ( const cg::node * nd : events )
+      n += nd->shower().size();
+  }));
+
+  // the same over the events in parallel
+  cg::thread_pool workers(cfg.threads);
+  results.push_back(measure("traverse_parallel",cfg.repeat,nodes,0U,[&]() {
+    cg::parallel_for_each_event(events,[](const cg::node * nd, size_t) {
+      energy_sum sum;
+      cg::traverse(nd,sum);
+    },workers);
+  }));
+
+  results.push_back(measure("shower_parallel",cfg.repeat,nodes,0U,[&]() {
+    cg::parallel_reduce(events,size_t(0U),
+      [](size_t & n, const cg::node * nd) { n += nd->shower().size(); },
+      [](size_t & n, const size_t & m) { n += m; },workers);
+  }));
+
+  // aggregates (computed once, then cached)
+  results.push_back(measure("totalenergy",1U,nodes,0U,[&]() {
+    for ( const cg::node * nd : events )
+      nd->totalenergy();
+  }));
+
+  // selection of nodes, compiled on compact graphs and by a walk
+  std::vector<cg::compact_graph> compacts(events.size());
+  results.push_back(measure("compact_build",cfg.repeat,nodes,0U,[&]() {
+    for ( size_t e=0; e != events.size(); e++ )
+      compacts[e].build(events[e]);
+  }));
+
+  const cg::compiled_filter photons(cg::node_filter::pdg(22)
+    && cg::node_filter::created_by("compt") && cg::node_filter::time(0.,0.5));
+  size_t selected = 0U;
+  results.push_back(measure("select_compiled",cfg.repeat,nodes,0U,[&]() {
+    selected = 0U;
+    for ( const cg::compact_graph & g : compacts )
+      selected += photons.count(g);
+  }));
+
+  size_t walked = 0U;
+  results.push_back(measure("select_walk",cfg.repeat,nodes,0U,[&]() {
+    walked = 0U;
+    std::vector<const cg::node *> stack;
+    for ( const cg::node * root : events ) {
+      stack.assign(1U,root);
+      while ( !stack.empty() ) {
+        const cg::node * nd = stack.back();
+        stack.pop_back();
+        const bool compt = nd->type() == cg::processNode
+          && static_cast<const cg::process *>(nd)->name() == "compt";
+        for ( const cg::node * child : nd->children() ) {
+          if ( compt && cg::track::is_track(child->type())
+              && static_cast<const cg::track *>(child)->pdg() == 22
+              && child->pos().t_ >= 0. && child->pos().t_ < 0.5 )
+            walked++;
+          stack.push_back(child);
+        }
+      }
+    }
+  }));
+  if ( selected != walked )
+    std::cerr << "cgbench: selections differ " << selected << " " << walked << std::endl;
+
+  // lookups of random ids
+  std::vector<std::vector<cg::node_id> > ids(events.size());
+  {
+    std::mt19937_64 rng(cfg.seed+1U);
+    for ( size_t e=0; e != events.size(); e++ ) {
+      const auto sh = events[e]->shower();
+      for ( unsigned i=0; i != cfg.lookups; i++ )
+        ids[e].push_back(sh[rng()%sh.size()]->id());
+    }
+  }
+  const unsigned nsearch = std::min(cfg.lookups,100U);
+  results.push_back(measure("find_search",1U,uint64_t(nsearch)*events.size(),0U,[&]() {
+    for ( size_t e=0; e != events.size(); e++ )
+      for ( unsigned i=0; i != nsearch; i++ )
+        events[e]->find(ids[e][i]);
+  }));
+  results.push_back(measure("index_build",cfg.repeat,nodes,0U,[&]() {
+    for ( cg::node * nd : events )
+      nd->build_index();
+  }));
+  results.push_back(measure("find_indexed",cfg.repeat,uint64_t(cfg.lookups)*events.size(),0U,[&]() {
+    for ( size_t e=0; e != events.size(); e++ )
+      for ( cg::node_id id : ids[e] )
+        events[e]->find(id);
+  }));
+  for ( cg::node * nd : events )
+    nd->drop_index();
+
+  // write and read each format
+  std::stringstream fmts(cfg.formats);
+  std::string fmt;
+  while ( std::getline(fmts,fmt,',') ) {
+    const bool text = fmt == "text";
+    const cg::compression comp = fmt == "zlib" ? cg::fastCompression : cg::noCompression;
+    if ( !text && fmt != "binary" && fmt != "zlib" ) {
+      std::cerr << "cg: unknown format " << fmt << std::endl;
+      continue;
+    }
+    const std::string name = cfg.file+"."+fmt+(text ? ".txt" : ".cg");
+
+    bench_result wrt = measure("write_"+fmt,cfg.repeat,nodes,0U,[&]() {
+      cg::WriteCollection(events,name,text ? cg::textFormat : cg::binaryFormat,comp);
+    });
+    wrt.bytes = file_size(name);
+    results.push_back(wrt);
+    stats["file_bytes_per_node_"+fmt] = nodes ? double(wrt.bytes)/nodes : 0.;
+
+    results.push_back(measure("read_"+fmt,cfg.repeat,nodes,wrt.bytes,[&]() {
+      cg::node_collection nc = cg::ReadCollection(name);
+      release(nc);
+    }));
+
+    if ( !text ) {
+      results.push_back(measure("read_parallel_"+fmt,cfg.repeat,nodes,wrt.bytes,[&]() {
+        cg::node_collection nc = cg::ReadCollectionParallel(name,cfg.threads);
+        release(nc);
+      }));
+      results.push_back(measure("mapped_traverse_"+fmt,cfg.repeat,nodes,wrt.bytes,[&]() {
+        cg::mapped_collection mc(name);
+        double E = 0.;
+        for ( size_t i=0; i != mc.size(); i++ )
+          for ( const cg::node_view & nv : mc[i].subgraph() )
+            E += nv.energy();
+      }));
+    }
+    std::remove(name.c_str());
+  }
+
+  if ( !cfg.pooled ) {
+    release(events);
+    std::remove((cfg.file+".cg").c_str());
+  }
+  stats["peak_rss_kb"] = peak_rss();
+
+  // results
+  if ( cfg.out.empty() ) {
+    write_json(std::cout,cfg,stats,results);
+  } else {
+    std::ofstream out(cfg.out);
+    write_json(out,cfg,stats,results);
+  }
+
+  return 0;
+}
@@ -0,0 +1,105 @@
+
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+
+#include "CaloGraphy.h"
+
+
+// seconds since an arbitrary start
+double now() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+int main(int argc, char **argv) {
+
+  if ( argc < 2 ) {
+    std::cout << "cgreplay <trace-file> [trajectories=0|1] [indexed=0|1] [pooled=0|1]\n"
+      << "         [min-deposit=E] [max-depth=N] [repeat=N] [out=FILE] [format=binary|text]" << std::endl;
+    return 1;
+  }
+
+  // options
+  cg::graph_builder builder;
+  bool pooled = false;
+  unsigned repeat = 1U;
+  std::string out;
+  cg::io_format fmt = cg::binaryFormat;
+  for ( int i=2; i != argc; i++ ) {
+    const std::string arg(argv[i]);
+    const size_t eq = arg.find('=');
+    const std::string key = arg.substr(0,eq);
+    const std::string val = eq != std::string::npos ? arg.substr(eq+1U) : std::string();
+    if ( key == "trajectories" ) builder.set_trajectories(std::stoul(val) != 0U);
+    else if ( key == "indexed" ) builder.set_indexed(std::stoul(val) != 0U);
+    else if ( key == "pooled" ) pooled = std::stoul(val) != 0U;
+    else if ( key == "min-deposit" ) builder.policy().set_min_deposit(std::stod(val));
+    else if ( key == "max-depth" ) builder.policy().set_max_depth(std::stoul(val));
+    else if ( key == "repeat" ) repeat = std::max<unsigned>(std::stoul(val),1U);
+    else if ( key == "out" ) out = val;
+    else if ( key == "format" ) fmt = val == "text" ? cg::textFormat : cg::binaryFormat;
+    else {
+      std::cout << "unknown option " << arg << std::endl;
+      return 1;
+    }
+  }
+
+  // load the trace, so the replay is not slowed down by reading
+  cg::step_trace trace(argv[1]);
+  if ( !trace.is_open() )
+    return 1;
+  std::vector<std::vector<cg::step_record> > events(1U);
+  size_t nsteps = 0U;
+  while ( trace.next_event(events.back()) ) {
+    nsteps += events.back().size();
+    events.emplace_back();
+  }
+  events.pop_back();
+
+  // replay, the graphs of the last repetition are kept
+  std::unique_ptr<cg::arena> pool(pooled ? new cg::arena : NULL);
+  cg::node_collection graphs;
+  double best = 0.;
+  for ( unsigned r=0; r != repeat; r++ ) {
+    if ( pool ) {
+      pool->reset();
+    } else {
+      for ( cg::node * nd : graphs )
+        delete nd;
+    }
+    graphs.clear();
+
+    cg::arena::scope s(pool.get());
+    const double t0 = now();
+    for ( const auto & steps : events )
+      graphs.push_back(cg::replay(steps,builder));
+    const double dt = now()-t0;
+    best = r == 0U ? dt : std::min(best,dt);
+  }
+
+  size_t nnodes = 0U;
+  for ( const cg::node * nd : graphs )
+    nnodes += nd ? nd->shower().size() : 0U;
+
+  std::cout << "events " << events.size() << " steps " << nsteps << " nodes " << nnodes
+    << " time " << best << " s  " << (best > 0. ? nsteps/best : 0.) << " steps/s  "
+    << (best > 0. ? nnodes/best : 0.) << " nodes/s" << std::endl;
+
+  // write the graphs (to compare with the output of the simulation)
+  if ( !out.empty() ) {
+    graphs.erase(std::remove(graphs.begin(),graphs.end(),(cg::node *)NULL),graphs.end());
+    cg::WriteCollection(graphs,out,fmt);
+  }
+
+  if ( !pool ) {
+    for ( cg::node * nd : graphs )
+      delete nd;
+  }
+
+  return 0;
+}
@@ -9,14 +9,14 @@
 #include "CaloGraphyIO.h"
 
 
-void dump_graph(std::ofstream & strm, cg::node * nd, int parent){
+void dump_graph(std::ofstream & strm, cg::node * nd, int64_t parent){
 
   // dump information about the node
   // get the type
   auto tp = nd->type();
   auto id = nd->id();
   strm << "  " << id;
-  if ( tp == cg::trackNode ) { 
+  if ( cg::track::is_track(tp) ) { 
     strm << " [ label=\"" << ((cg::track*)nd)->G4TrackID() << " pdg(" 
       << ((cg::track*)nd)->pdg() 
       << ")\" " << " shape=\"diamond\" ];";
@@ -33,7 +33,7 @@ void dump_graph(std::ofstream & strm, cg::node * nd, int parent){
     strm << "  " << parent << " -> " << id << std::endl;
 
   // go through the children
-  const std::vector<cg::node *> & children = nd->children();
+  const cg::node_list & children = nd->children();
   const unsigned nkids = children.size();
   for ( unsigned i=0; i != nkids; i++ ){
     dump_graph(strm,children[i],id);
@@ -52,13 +52,13 @@ int main(int argc, char **argv) {
   std::string fileName(argv[1]);
   int evnum = atoi(argv[2]);
 
-  // read the collection
-  cg::node_collection col = cg::ReadCollection(fileName);
+  // load the graph of the event
+  cg::track * grph = (cg::track*)cg::ReadGraph(fileName,evnum);
 
-  assert(evnum < col.size());
-
-  // load the graph
-  cg::track * grph = (cg::track*)col[evnum];
+  if ( !grph ) {
+    std::cout << "event " << evnum << " not found in " << fileName << std::endl;
+    return 1;
+  }
 
   // start the graphviz image
   // open the file
@@ -76,6 +76,8 @@ int main(int argc, char **argv) {
 
   // close the file 
   gv.close();
+
+  delete grph;
    
 
   return 0;